@@ -0,0 +1,105 @@
+#!/bin/sh
+#
+# Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Project:    HEIA-FR / Embedded Systems 3 Laboratory
+#
+# Abstract:   Hasciicam client/server application
+#
+# Author:     C. Vallélian & G. Waeber
+# Class:      T-3a
+# Date:       19.01.2017
+#
+#
+# Server -> linkem -> client on loopback, once per link profile and protocol
+# mode. The server streams its synthetic camera (-c test) in fragments sized
+# for Ethernet (-u 1500), a loss hits part of a frame. Each run leaves in
+# $OUT (default linkem_reports) :
+#
+#   <profile>.<mode>.linkem.json   linkem report
+#   <profile>.<mode>.client.txt    client NACK and latency summary
+#   <profile>.<mode>.server.txt    server stats at the end of the run
+#
+# and the linkem reports, tagged with profile and mode, in $OUT/linkem.jsonl.
+# The control socket is driven with nc -U. Run from bench/ after building the
+# server and the client for this machine (make -C ../server CC=gcc).
+#
+# Environment : DURATION (s per run, default 10), SEED (default 1),
+#               PROFILES and MODES to run a subset (names below)
+
+DURATION=${DURATION:-10}
+SEED=${SEED:-1}
+OUT=${OUT:-linkem_reports}
+CTRL=/tmp/hasciicamCtrl
+SERVER=../server/server
+CLIENT=../client/client
+
+# name:linkem options
+ALL_PROFILES="clean:-p0 loss1:-p10 loss5:-p50 burst5:-p50,-b4 delay:-d40,-j20 reorder:-o50 rate:-r1000"
+# nack : client default, nonack : client -n, rle : NACK and codec rle
+ALL_MODES="nack nonack rle"
+
+PROFILES=${PROFILES:-$(for p in $ALL_PROFILES; do printf '%s ' "${p%%:*}"; done)}
+MODES=${MODES:-$ALL_MODES}
+
+for f in $SERVER $CLIENT ./linkem; do
+   [ -x $f ] || { echo "$f missing, build it first" >&2; exit 1; }
+done
+command -v nc > /dev/null || { echo "nc missing, needed for the control socket" >&2; exit 1; }
+
+ctrl(){
+   echo "$1" | nc -w 1 -U $CTRL
+}
+
+mkdir -p $OUT
+: > $OUT/linkem.jsonl
+
+for name in $PROFILES; do
+   opts=""
+   for p in $ALL_PROFILES; do
+      [ "${p%%:*}" = "$name" ] && opts=$(echo "${p#*:}" | tr ',' ' ')
+   done
+   [ -n "$opts" ] || { echo "unknown profile $name" >&2; continue; }
+
+   for mode in $MODES; do
+      run=$OUT/$name.$mode
+      echo "$name ($opts) $mode"
+
+      $SERVER -c test -u 1500 > $run.server.log 2>&1 &
+      server=$!
+      sleep 1
+      ctrl start > /dev/null
+      [ $mode = rle ] && ctrl "codec rle" > /dev/null
+
+      ./linkem -t $((DURATION+1)) -S $SEED $opts > $run.linkem.json 2> $run.linkem.log &
+      linkem=$!
+      sleep 0.2
+
+      # The client asks the server address on stdin, prints its summary on SIGINT
+      flags=""
+      [ $mode = nonack ] && flags="-n"
+      (echo 127.0.0.1; sleep $((DURATION+1))) | timeout -s INT $DURATION $CLIENT -s 1235 $flags 2>&1 |
+         grep -a -A2 "NACKs sent\|Capture to display" > $run.client.txt
+
+      wait $linkem
+      ctrl stats > $run.server.txt
+      kill $server
+      wait $server 2> /dev/null
+
+      sed "s/^{/{\"profile\":\"$name\",\"mode\":\"$mode\",/" $run.linkem.json >> $OUT/linkem.jsonl
+   done
+done
+
+echo "Reports in $OUT"
@@ -0,0 +1,125 @@
+#!/bin/sh
+#
+# Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Project:    HEIA-FR / Embedded Systems 3 Laboratory
+#
+# Abstract:   Hasciicam client/server application
+#
+# Author:     C. Vallélian & G. Waeber
+# Class:      T-3a
+# Date:       19.01.2017
+#
+#
+# Server features checked end to end on loopback, with the synthetic camera
+# and one client. One JSON line per scenario on stdout, the server stats of
+# each run in $OUT (default scenario_reports) :
+#
+#   idle     the moving scene (-c test) and the still one (-c test-still) :
+#            frames suppressed, keepalives and bytes saved
+#   replay   DURATION s recorded, replayed at 200%, then replayed again from
+#            2 s after the start of the recording (seek in the segment)
+#
+# The control socket is driven with nc -U. Run from bench/ after building the
+# server and the client for this machine (make -C ../server CC=gcc).
+#
+# Environment : DURATION (s per run, default 4), SCENARIOS to run a subset
+
+DURATION=${DURATION:-4}
+OUT=${OUT:-scenario_reports}
+SCENARIOS=${SCENARIOS:-idle replay}
+CTRL=/tmp/hasciicamCtrl
+ARCHIVE_DIR=/tmp/hasciicamArchive
+SERVER=../server/server
+CLIENT=../client/client
+
+for f in $SERVER $CLIENT; do
+   [ -x $f ] || { echo "$f missing, build it first" >&2; exit 1; }
+done
+command -v nc > /dev/null || { echo "nc missing, needed for the control socket" >&2; exit 1; }
+
+ctrl(){
+   echo "$1" | nc -w 1 -U $CTRL
+}
+
+# Value of a counter in a stats dump
+stat(){
+   awk -v name="$2" '$1 == name { print $2; exit }' $1
+}
+
+# server_start <run> <server options>...
+server_start(){
+   run=$1
+   shift
+   $SERVER "$@" > $run.server.log 2>&1 &
+   server=$!
+   sleep 1
+   ctrl start > /dev/null
+}
+
+server_stop(){
+   ctrl stats > $run.server.txt
+   kill $server
+   wait $server 2> /dev/null
+}
+
+# client <seconds> : subscribed for that long, the server address asked on stdin
+client(){
+   (echo 127.0.0.1; sleep $(($1+1))) | timeout -s INT $1 $CLIENT > /dev/null 2>&1
+}
+
+# Unchanged frames are not sent, a keepalive per idle heartbeat instead (user-031)
+scenario_idle(){
+   for device in test test-still; do
+      server_start $OUT/idle.$device -c $device
+      client $DURATION
+      server_stop
+      printf '{"bench":"scenario","variant":"idle %s","seconds":%i,"frames_sent":%s,"frames_idle":%s,"keepalives":%s,"idle_bytes_saved":%s}\n' \
+             $device $DURATION $(stat $run.server.txt frames_sent) $(stat $run.server.txt frames_idle) \
+             $(stat $run.server.txt keepalives) $(stat $run.server.txt idle_bytes_saved)
+   done
+}
+
+# Frames recorded, replayed and found by capture time (user-034)
+scenario_replay(){
+   server_start $OUT/replay -c test
+   ctrl "record on" > /dev/null
+   sleep $DURATION
+   ctrl "record off" > /dev/null
+   ctrl stats > $run.record.txt
+
+   # Segment files are named by the capture time of their first frame
+   from=$(ls $ARCHIVE_DIR | sort | tail -n 1 | tr -dc 0-9 | sed 's/^0*//')
+
+   client $((DURATION*2+2)) &
+   sleep 0.5
+   ctrl "replay $from 200" > /dev/null
+   sleep $((DURATION/2+1))
+   ctrl stats > $run.replay.txt
+   ctrl "replay $((from+2000000)) 100" > /dev/null
+   sleep $((DURATION-1))
+   server_stop
+   wait
+
+   replayed=$(stat $run.replay.txt frames_replayed)
+   printf '{"bench":"scenario","variant":"replay","seconds":%i,"frames_recorded":%s,"record_segments":%s,"frames_replayed_200":%s,"frames_replayed_seek_2s":%i,"replays":%s}\n' \
+          $DURATION $(stat $run.record.txt frames_recorded) $(stat $run.record.txt record_segments) $replayed \
+          $(($(stat $run.server.txt frames_replayed)-replayed)) $(stat $run.server.txt replays)
+}
+
+mkdir -p $OUT
+for s in $SCENARIOS; do
+   scenario_$s
+done
@@ -0,0 +1,62 @@
+#pragma once
+#ifndef CLIENT_RELAY_H
+#define CLIENT_RELAY_H
+
+
+/**
+* Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Project:    HEIA-FR / Embedded Systems 3 Laboratory
+*
+* Abstract:   Hasciicam client/server application
+*
+* Author:     C. Vallélian & G. Waeber
+* Class:      T-3a
+* Date:       19.01.2017
+*/
+
+
+
+/*
+    Relay mode : the client subscribes once to its server and serves the
+    frames to its own subscribers with the same protocol. Relays can be
+    chained to distribute the stream as a tree.
+
+    Fragments are forwarded as received. The last complete frame is kept
+    and sent to new subscribers, they do not wait for the next frame.
+*/
+
+
+
+/**
+ * Method to relay the stream received on the upstream socket to the clients
+ * subscribing on the given port. Returns when the upstream server stops.
+ *
+ * @param up    socket connected and subscribed to the upstream server
+ * @param port  UDP port of the downstream subscribers
+ *
+ * @return 0 when the upstream server stops, -1 if the port cannot be used
+ */
+int relayRun(int up, int port);
+
+/**
+ * Method to inform the downstream subscribers that the relay stops and to
+ * close the downstream socket
+ */
+void relayClose(void);
+
+
+
+#endif
@@ -27,6 +27,7 @@
 */
 
 #include <arpa/inet.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 
@@ -34,8 +35,41 @@
 // SERVER
 // -----------------------------------------------------------------------------
 
-#define FIFO_PATH "/tmp/hasciicamFifo"      // FIFO path
-#define FIFO_BUF_SIZE 3204                  // FIFO buffer size (video 352x288  / ASCII 88x36)
+#define FIFO_PATH "/tmp/hasciicamFifo"      // FIFO path of channel 0, FIFO_PATH<n> for channel n
+#define FIFO_PATH_SIZE 64                   // max length of a channel FIFO path
+#define FIFO_BUF_SIZE 16384                 // max frame size (ASCII 88x36 for 352x288, up to 200x75 for 800x600)
+#define FIFO_MAX_ROWS 128                   // max rows of a frame, each row ends with '\n'
+#define FIFO_MAGIC    0x48434d46            // "HCMF", start of a frame header in the FIFO
+#define COLOUR_BUF_SIZE FIFO_BUF_SIZE       // max colour runs following the text of a colour frame
+
+// Written by hasciicam in front of each frame, header and frame in one write
+struct FIFO_FRAME_HEADER {
+    uint32_t   magic;            // FIFO_MAGIC
+    uint32_t   length;           // frame length following the header
+    uint64_t   capture_us;       // V4L2 buffer timestamp (CLOCK_MONOTONIC, us)
+    uint64_t   write_us;         // FIFO write time (CLOCK_MONOTONIC, us)
+    uint16_t   columns;          // characters per row, '\n' excluded, 0 if unknown
+    uint16_t   rows;             // rows of the frame, 0 if unknown
+    uint32_t   pid;              // writer process, signalled the demand (SIGUSR1), 0 if unknown
+};
+
+#define FRAME_HELD_SLABS    (NACK_CACHE_FRAMES+RECORD_MAX_PENDING)  // slabs still held once sent : NACK cache and recorder queue
+#define CAPTURE_POOL_SLABS  (8+FRAME_HELD_SLABS)   // frames of an in-process capture in flight to server_thr_send, and held once sent
+#define SEND_POOL_SLABS     (16+FRAME_HELD_SLABS)  // slabs of server_thr_send receiving the FIFO frames, and held once sent
+#define CAPTURE_RENDER_HOP  2        // one frame rendered every CAPTURE_RENDER_HOP captured, as hasciicam
+#define CAPTURE_RETRY_MS    1000     // reopen delay of a failed capture device (ms)
+#define CAPTURE_TIMEOUT_MS  1000     // wait for a camera frame before counting a timeout (ms)
+#define CAPTURE_TIMEOUTS    3        // timeouts in a row before the capture device is reopened
+#define CAPTURE_DRIVER_BUFFERS 4     // camera buffers requested to the driver by default (server -b)
+#define CAPTURE_TEST_FPS    25       // frame rate of the synthetic "test" capture device
+#define CAPTURE_USAGE_FRAMES 64      // frames between two context switch samples of a capture thread
+#define CAPTURE_PYRAMID_LEVELS 4     // grey image halvings a camera builds for its outputs (server -o)
+#define CAPTURE_IDLE_FPS    1        // frames rendered per second while nobody is watching
+
+// Demand of a capture, from the stream state (SW2) and the viewers of its channel
+#define DEMAND_STOP  0     // stream off : camera stopped, device kept open
+#define DEMAND_IDLE  1     // stream on, nobody watching : CAPTURE_IDLE_FPS frames per second
+#define DEMAND_LIVE  2     // subscribers, recording or HTTP viewers : every frame
 
 #define IO_DD_PATH "/dev/io_dd"             // I/O device driver path
 #define IO_DD_NAME "io_dd"                  // I/O device driver file name
@@ -46,7 +80,69 @@
 #define LED_NB  4          // number of LEDs
 
 #define MAX_CLIENTS 4      // number of clients that can be connected at the same time
-#define MSG_SIZE    1000   // size of the data send to the client throught the socket
+#define MSG_SIZE    1000   // smallest data size of a fragment, used when the path MTU is unknown
+#define MSG_MAX_SIZE 8192  // largest data size of a fragment (jumbo frames, loopback)
+#define UDP_IP_HEADERS 28  // IPv4 and UDP headers, taken from the path MTU
+#define GSO_MAX_SEGMENTS ((FIFO_BUF_SIZE+COLOUR_BUF_SIZE+MSG_SIZE-1)/MSG_SIZE) // fragments of the largest frame, sent in one call (UDP_SEGMENT)
+#define MAX_CHANNELS 4     // number of streams (frame sources) hosted by the server
+
+#define SERVER_PORT 1234   // UDP port of the server socket
+
+#define RECEIVE_BATCH    32      // client datagrams drained (and answered) per recvmmsg
+#define RATE_TABLE_SIZE  256     // sources tracked by the rate limiter (power of 2)
+#define RATE_PER_SECOND  20      // client datagrams per second and source address
+#define RATE_BURST       40      // client datagrams a source can send at once
+#define COOKIE_PERIOD    10      // subscribe cookie validity (s), the previous period is accepted too
+
+#define CTRL_SOCKET_PATH "/tmp/hasciicamCtrl"   // Unix domain control socket path
+#define CTRL_MAX_CONN    4                      // number of control connections at the same time
+#define CTRL_LINE_SIZE   128                    // max length of a control command line
+#define CTRL_MAX_FPS     1000                   // max rate of the "fps" command
+#define CTRL_MAX_IDLE_MS 3600000                // max keepalive period of the "idle" command
+#define CTRL_MAX_SPEED   10000                  // max speed (%) of the "replay" command
+
+#define HTTP_PORT        8080    // TCP port of the HTTP streaming endpoint
+#define HTTP_MAX_CONN    16      // number of HTTP connections at the same time
+#define HTTP_REQUEST_SIZE 1024   // max size of an HTTP request head
+#define HTTP_OUT_SIZE    (2*FIFO_BUF_SIZE) // pending output of a slow HTTP connection
+#define HTTP_STOPPED_POLL 100    // HTTP connections served while the stream is off, the stream state looked at in between (ms)
+
+#define STATS_PROM_PATH     "/tmp/hasciicamServer.prom"   // Prometheus text dump of the server stats
+#define STATS_DUMP_PERIOD   1000                          // Prometheus dump period (ms)
+
+#define SCHED_STAGE_CAPTURE 0      // hasciicam processes
+#define SCHED_STAGE_SEND    1      // server_thr_send
+#define SCHED_STAGE_RECEIVE 2      // server_thr_receive
+#define SCHED_STAGE_IO      3      // server_thr_io
+#define SCHED_STAGE_RECORD  4      // server_thr_record
+#define SCHED_STAGE_REPLAY  5      // server_thr_replay
+#define SCHED_STAGES        6      // stages with a CPU set and a priority (server -a)
+
+#define IDLE_HEARTBEAT      1000   // keepalive period while the scene does not change (ms), 0 to send every frame
+
+#define ARCHIVE_DIR         "/tmp/hasciicamArchive"   // directory of the recorded segments
+#define ARCHIVE_MAGIC       0x52414348                // "HCAR", start of a segment file
+#define ARCHIVE_VERSION     1                         // segment file format version
+#define ARCHIVE_FRAMES      4096                      // frames per segment file
+#define RECORD_MAX_PENDING  8                         // frames queued to the recorder, more are not recorded
+#define REPLAY_SLICE        100                       // replay pacing sleep slice, control latency (ms)
+
+#define TIMESHIFT_BYTES     (2*1024*1024)   // memory budget of the recent frames ring (RLE frames)
+#define TIMESHIFT_ENTRIES   4096            // max frames in the ring
+#define TIMESHIFT_CATCHUP   2               // ring frames sent per live frame to a client behind live
+
+#define TIER_COUNT          3      // quality tiers, 0 is the full stream
+#define TIER_LOSS_DOWN      50     // loss above this (per mille) moves a client one tier down
+#define TIER_LOSS_UP        10     // loss below this (per mille) is a good report
+#define TIER_JITTER_DOWN    20000  // jitter above this (us) moves a client one tier down
+#define TIER_JITTER_UP      5000   // jitter below this (us) is a good report
+#define TIER_UP_REPORTS     3      // good reports in a row to move one tier up
+
+#define NACK_CACHE_FRAMES   8      // frames sent whose fragments can be sent again on a NACK
+#define NACK_DEADLINE_MS    150    // a frame older than this is abandoned, its fragments are not sent again
+#define NACK_RATE           200    // fragments sent again per second and client
+#define NACK_BURST          64     // fragments a client can get sent again at once
+#define NACK_BATCH          4      // fragments of a frame sent between two looks at the NACKs
 
 /*
     Options (32 bit)   -   LSB to MSB
@@ -61,25 +157,78 @@
     |     |        |     0 | -                        |
     |   3 | STOP   |     1 | dernier fragment de data |
     |     |        |     0 | -                        |
+    | 4-7 | CODEC  |     0 | data brutes (raw)        |
+    |     |        |     1 | data RLE                 |
+    |   8 | PROBE  |     1 | reponse a CMD_PROBE      |
+    |     |        |     0 | -                        |
+    |   9 | ALIVE  |     1 | keepalive, image fixe    |
+    |     |        |     0 | -                        |
+    |  10 | COOKIE |     1 | cookie a renvoyer dans   |
+    |     |        |       | CMD_SUBSCRIBE            |
+    |     |        |     0 | -                        |
+    |11-12| COLOUR |     0 | texte monochrome         |
+    |     |        |     1 | texte + runs 256 couleurs|
+    |     |        |     2 | texte + runs truecolor   |
     +-----+--------+-------+--------------------------+
-    Data (MSG_SIZE bytes)
+    Frame ID (32 bit), fragment index and count (2 x 16 bit)
+    Capture time (64 bit, server CLOCK_REALTIME, us)
+    Frame geometry : columns and rows (2 x 16 bit)
+    Payload : frame bytes per fragment, all the fragments but the last (16 bit), reserved (16 bit)
+    Data (MSG_SIZE to MSG_MAX_SIZE bytes, from the path MTU of the client)
+
+    A colour frame is its text, rows x (columns+1) bytes, followed by the
+    colour of each cell as runs : count (1 byte) and colour, a palette index
+    (256 colours) or R, G, B (truecolour). The client writes the escapes.
 */
 
 #define SUB_BIT     0      // SUBSCRIBE bit in the options uint32
 #define STREAM_BIT  1      // STREAM bit in the options uint32
 #define START_BIT   2      // START bit in the options uint32
 #define STOP_BIT    3      // STOP bit in the options uint32
+#define CODEC_BIT   4      // first CODEC bit in the options uint32
+#define CODEC_MASK  0x0F   // CODEC field mask (once shifted)
+#define PROBE_BIT   8      // PROBE bit in the options uint32
+#define ALIVE_BIT   9      // KEEPALIVE bit in the options uint32, no data, frame frame_id unchanged
+#define COOKIE_BIT  10     // COOKIE bit in the options uint32, subscribe again with the cookie in data
+#define COLOUR_BIT  11     // first COLOUR bit in the options uint32
+#define COLOUR_MASK 0x03   // COLOUR field mask (once shifted)
+
+#define CODEC_RAW   0      // fragment data sent as is
+#define CODEC_RLE   1      // fragment data run-length encoded
+
+#define COLOUR_NONE 0      // monochrome text
+#define COLOUR_256  1      // text and runs of xterm 256 colour palette indexes
+#define COLOUR_TRUE 2      // text and runs of R, G, B
+
+#define RLE_MARKER  0xFF   // RLE run marker, followed by count and character
+#define RLE_MIN_RUN 4      // shorter runs are sent as literals
 
 struct SERVER_DATA {
     uint32_t   options;          // options
     uint32_t   length;           // video data length
-    char       data[MSG_SIZE];   // video data
+    uint32_t   frame_id;         // frame sequence number
+    uint16_t   fragment;         // fragment index in the frame, from 0
+    uint16_t   fragments;        // number of fragments of the frame
+    uint64_t   capture_us;       // frame capture time (server CLOCK_REALTIME, us)
+    uint16_t   columns;          // characters per row of the frame, '\n' excluded
+    uint16_t   rows;             // rows of the frame
+    uint16_t   payload;          // frame bytes per fragment : fragment i starts at i*payload
+    uint16_t   reserved;         // alignment
+    char       data[MSG_MAX_SIZE]; // video data
+};
+
+// Data of a PROBE answer
+struct PROBE_DATA {
+    uint64_t   client_us;        // client time in the CMD_PROBE request
+    uint64_t   server_us;        // server CLOCK_REALTIME when answering (us)
 };
 
 // Used to store client sockets
 struct SOCKET_TAB_STRUCT {
    struct sockaddr_in socket;
    bool               used;
+   uint32_t           rewind_ms;     // subscribed this far behind live, 0 for live
+   uint32_t           channel;       // channel subscribed to
 };
 
 
@@ -90,20 +239,60 @@ struct SOCKET_TAB_STRUCT {
 // -----------------------------------------------------------------------------
 
 /*
-    Options (32 bit)   -   LSB to MSB
-    +-----+--------+-------+--------------------------+
-    | BIT |  NAME  | VALUE |         MEANING          |
-    +-----+--------+-------+--------------------------+
-    |   0 | CMD    |     1 | subscribe                |
-    |     |        |     0 | unsubscribe              |
-    +-----+--------+-------+--------------------------+
+    Options (32 bit)
+    +-------+--------------------------------------------+
+    | VALUE |                 MEANING                    |
+    +-------+--------------------------------------------+
+    |     0 | unsubscribe                                |
+    |     1 | subscribe                                  |
+    |     2 | clock probe, answered with the PROBE bit   |
+    |     3 | receiver report                            |
+    |     4 | NACK, missing fragments of a frame         |
+    +-------+--------------------------------------------+
 */
 
 #define CMD_SUBSCRIBE     1
 #define CMD_UNSUBSCRIBE   0
+#define CMD_PROBE         2
+#define CMD_REPORT        3
+#define CMD_NACK          4
+
+#define CLIENT_PROBE_PERIOD    2000   // clock probe period (ms)
+#define CLIENT_REPORT_PERIOD   1000   // receiver report period (ms)
+#define CLIENT_SUBSCRIBE_RETRY 500    // subscription sent again until the server answers (ms)
+#define CLIENT_RX_FRAMES       8      // frames reassembled at once : the newest and the older ones waiting for their retransmissions (NACK_DEADLINE_MS)
+#define CLIENT_NACK_TRIES      2      // NACKs sent for one frame
+#define CLIENT_NACK_RETRY      30     // delay before asking again the fragments of a frame (ms)
+#define CLIENT_NACK_GAP        30     // silence of an incomplete frame before its missing fragments are asked (ms), a lost STOP fragment
+#define CLIENT_NACK_REORDER    5      // silence after the STOP fragment or a newer frame before the missing fragments are asked (ms), plus twice the jitter
+
+#define RELAY_MAX_FRAGMENTS    ((FIFO_BUF_SIZE+COLOUR_BUF_SIZE+MSG_SIZE-1)/MSG_SIZE)   // fragments of a frame kept by a relay
+#define RELAY_POLL_PERIOD      1000   // relay event loop timeout (ms)
+
+// Reception quality and capture to display latency seen by the client
+struct CLIENT_REPORT {
+    int64_t    clock_offset;     // server minus client clock (us), 0 if not probed
+    uint32_t   frames;           // frames displayed with all their fragments
+    uint32_t   latency_p50;      // capture to paint latency percentiles (us)
+    uint32_t   latency_p95;
+    uint32_t   latency_p99;
+    uint32_t   latency_max;
+    uint32_t   incomplete;       // frames with missing fragments (reassembly failures)
+    uint32_t   jitter_us;        // interarrival jitter of the frames (RFC 3550, us)
+    uint32_t   reserved;         // alignment
+};
 
 struct CLIENT_DATA {
-    uint32_t   options;
+    uint32_t             options;    // CMD_*
+    uint32_t             rewind_ms;  // CMD_SUBSCRIBE : start this far behind live (ms), 0 for live
+    uint64_t             client_us;  // CMD_PROBE : client CLOCK_REALTIME (us)
+    struct CLIENT_REPORT report;     // CMD_REPORT
+    uint32_t             channel;    // CMD_SUBSCRIBE : channel, 0 to MAX_CHANNELS-1
+    uint32_t             reserved;   // alignment
+    uint64_t             cookie;     // CMD_SUBSCRIBE : cookie of the server answer, 0 at first
+    uint32_t             frame_id;   // CMD_NACK : frame with missing fragments
+    uint32_t             reserved2;  // alignment
+    uint64_t             missing;    // CMD_NACK : bitmap of the missing fragments, fragment i is bit i
 };
 
 
@@ -118,10 +307,16 @@ struct CLIENT_DATA {
 #define QUEUE_THR_IPC_SERVER_TABLE    3
 #define QUEUE_THR_IPC_SERVER_SOCKET   4
 #define QUEUE_THR_IPC_SERVER_BUTTON   5
+#define QUEUE_THR_IPC_SERVER_CONFIG   6
+#define QUEUE_THR_IPC_SERVER_REPORT   7
+#define QUEUE_THR_IPC_SERVER_RECORD   8
+#define QUEUE_THR_IPC_SERVER_REPLAY   9
 
 #define SENDER_CLIENT_THR_CLI         1
 #define SENDER_SERVER_THR_RECEIVE     2
 #define SENDER_SERVER_THR_BUTTON      3
+#define SENDER_SERVER_CTRL            4
+#define SENDER_SERVER_THR_SEND        5
 
 #define MAX_SIZE    16
 #define MSG_TYPE     1
@@ -175,6 +370,73 @@ struct MSG_SRV_BUTTON {
 };
 
 
+// Pass stream configuration from the control socket to server_thr_send
+struct HEADER_SRV_CONFIG {
+   unsigned short sender;
+   unsigned int   fps;              // max frames per second sent, 0 for camera rate
+   unsigned int   codec;            // CODEC_RAW or CODEC_RLE
+   unsigned int   idle_ms;          // keepalive period of an unchanged scene, 0 to send every frame
+   bool           record;           // true to record the frames read from FIFO
+};
+
+struct MSG_SRV_CONFIG {
+   long int                  type;
+   struct HEADER_SRV_CONFIG  header;
+};
+
+
+// Pass receiver reports from server_thr_receive to server_thr_send
+struct HEADER_SRV_REPORT {
+   unsigned short       sender;
+   int                  client;     // index in the client socket table
+   struct CLIENT_REPORT report;     // report received from the client
+};
+
+struct MSG_SRV_REPORT {
+   long int                  type;
+   struct HEADER_SRV_REPORT  header;
+};
+
+
+// Pass the NACKs from server_thr_receive to server_thr_send, through nack_pipe
+struct HEADER_SRV_NACK {
+   unsigned short  sender;
+   int             client;          // index in the client socket table
+   uint32_t        frame_id;        // frame of the channel of the client
+   uint64_t        missing;         // bitmap of the missing fragments
+};
+
+
+// Pass the frames to record from server_thr_send to server_thr_record
+struct FRAME;
+
+struct HEADER_SRV_RECORD {
+   unsigned short  sender;
+   struct FRAME   *frame;           // frame referenced for the recorder, NULL to close the segment
+   uint32_t        frame_id;        // sequence number of the frames read from FIFO
+   uint64_t        capture_us;      // capture time (CLOCK_REALTIME, us)
+};
+
+struct MSG_SRV_RECORD {
+   long int                  type;
+   struct HEADER_SRV_RECORD  header;
+};
+
+
+// Pass replay requests from the control socket to server_thr_replay
+struct HEADER_SRV_REPLAY {
+   unsigned short sender;
+   bool           stop;             // true to stop the replay
+   uint64_t       from_us;          // first frame replayed (CLOCK_REALTIME, us), 0 for the oldest
+   unsigned int   speed;            // replay speed in percent, 100 for real time
+};
+
+struct MSG_SRV_REPLAY {
+   long int                  type;
+   struct HEADER_SRV_REPLAY  header;
+};
+
+
 
 
 #endif
@@ -0,0 +1,107 @@
+#pragma once
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+/**
+* Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Project:    HEIA-FR / Embedded Systems 3 Laboratory
+*
+* Abstract:   Hasciicam client/server application
+*
+* Author:     C. Vallélian & G. Waeber
+* Class:      T-3a
+* Date:       23.12.2016
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+    Pool of refcounted frame buffers
+
+    All the slabs are allocated once by framePoolInit, so the frame path does
+    no heap allocation in steady state. A stage borrows a slab with
+    framePoolGet (refcount 1), hands it over to other stages with frameRef
+    and each holder gives it back with frameRelease. The slab returns to the
+    pool when the last holder releases it.
+*/
+
+#define FRAME_POOL_SLABS  16     // default number of slabs of a pool
+
+struct FRAME_POOL;
+
+struct FRAME {
+   int                refcount;     // number of holders, atomic
+   uint32_t           length;       // used bytes in data, the text of a colour frame
+   uint32_t           colour_len;   // colour runs following the text in data, 0 if monochrome
+   uint32_t           colour;       // COLOUR_* of the runs
+   uint32_t           frame_id;     // frame sequence number
+   uint64_t           capture_us;   // capture time (CLOCK_MONOTONIC, us)
+   struct FRAME_POOL *pool;         // pool the slab belongs to
+   char              *data;         // slab of pool->slab_size bytes
+};
+
+struct FRAME_POOL {
+   pthread_mutex_t  lock;           // protects free_list and nb_free only
+   int              nb_slabs;       // number of slabs
+   int              slab_size;      // bytes per slab
+   int              nb_free;        // number of slabs in free_list
+   struct FRAME    *frames;         // nb_slabs frame descriptors
+   struct FRAME   **free_list;      // stack of the free slabs
+   char            *memory;         // nb_slabs * slab_size bytes
+   unsigned long    exhausted;      // framePoolGet calls without free slab
+};
+
+
+
+/**
+ * Method to allocate the slabs of a pool
+ *
+ * @param pool       pool to init
+ * @param nb_slabs   number of slabs
+ * @param slab_size  bytes per slab
+ *
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int framePoolInit(struct FRAME_POOL *pool, int nb_slabs, int slab_size);
+
+/**
+ * Method to free the slabs of a pool, all the frames must be released
+ */
+void framePoolDestroy(struct FRAME_POOL *pool);
+
+/**
+ * Method to borrow a free slab from the pool
+ *
+ * @return frame with refcount 1, NULL if all the slabs are in use
+ */
+struct FRAME *framePoolGet(struct FRAME_POOL *pool);
+
+/**
+ * Method to add a holder to a frame
+ *
+ * @return frame
+ */
+struct FRAME *frameRef(struct FRAME *frame);
+
+/**
+ * Method to release a frame, the slab returns to its pool with the last holder
+ */
+void frameRelease(struct FRAME *frame);
+
+
+
+#endif
@@ -27,7 +27,9 @@
 */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "data.h"
 
@@ -74,6 +76,243 @@ bool getStartFromOptions(uint32_t options);
  */
 bool getStopFromOptions(uint32_t options);
 
+/**
+ * Method to set the CODEC field in the options data
+ *
+ * @param options  options built with buildOptions
+ * @param codec    CODEC_RAW or CODEC_RLE
+ *
+ * @return options with the CODEC field set
+ */
+uint32_t setCodecInOptions(uint32_t options, unsigned int codec);
+
+/**
+ * Method to extract the CODEC field from the options data
+ *
+ * @return CODEC field
+ */
+unsigned int getCodecFromOptions(uint32_t options);
+
+/**
+ * Method to set the PROBE bit in the options data
+ *
+ * @param options  options built with buildOptions
+ *
+ * @return options with the PROBE bit set
+ */
+uint32_t setProbeInOptions(uint32_t options);
+
+/**
+ * Method to extract the PROBE bit from the options data
+ *
+ * @return PROBE bit
+ */
+bool getProbeFromOptions(uint32_t options);
+
+/**
+ * Method to set the KEEPALIVE bit in the options data
+ *
+ * @param options  options built with buildOptions
+ *
+ * @return options with the KEEPALIVE bit set
+ */
+uint32_t setKeepaliveInOptions(uint32_t options);
+
+/**
+ * Method to extract the KEEPALIVE bit from the options data
+ *
+ * @return KEEPALIVE bit
+ */
+bool getKeepaliveFromOptions(uint32_t options);
+
+/**
+ * Method to set the COOKIE bit in the options data
+ *
+ * @param options  options built with buildOptions
+ *
+ * @return options with the COOKIE bit set
+ */
+uint32_t setCookieInOptions(uint32_t options);
+
+/**
+ * Method to extract the COOKIE bit from the options data
+ *
+ * @return COOKIE bit
+ */
+bool getCookieFromOptions(uint32_t options);
+
+/**
+ * Method to set the COLOUR field in the options data
+ *
+ * @param options  options built with buildOptions
+ * @param colour   COLOUR_NONE, COLOUR_256 or COLOUR_TRUE
+ *
+ * @return options with the COLOUR field set
+ */
+uint32_t setColourInOptions(uint32_t options, unsigned int colour);
+
+/**
+ * Method to extract the COLOUR field from the options data
+ *
+ * @return COLOUR field
+ */
+unsigned int getColourFromOptions(uint32_t options);
+
+/**
+ * Method to get the wall clock time, used to compare times between hosts
+ *
+ * @return CLOCK_REALTIME in microseconds
+ */
+uint64_t getRealtimeUs(void);
+
+/**
+ * Method to convert a CLOCK_MONOTONIC time (V4L2 timestamps) to CLOCK_REALTIME
+ *
+ * @param monotonic_us  CLOCK_MONOTONIC time in microseconds
+ *
+ * @return CLOCK_REALTIME time in microseconds
+ */
+uint64_t monotonicToRealtimeUs(uint64_t monotonic_us);
+
+/**
+ * Method to run-length encode a fragment of video data. Runs of at least
+ * RLE_MIN_RUN identical characters become RLE_MARKER, count, character.
+ *
+ * @param src      raw video data
+ * @param srcLen   raw video data length
+ * @param dst      encoded data
+ * @param dstSize  size of the dst buffer
+ *
+ * @return encoded length, -1 if the encoded data does not fit in dst
+ */
+int rleEncode(const char *src, int srcLen, char *dst, int dstSize);
+
+/**
+ * Method to decode a run-length encoded fragment of video data
+ *
+ * @param src      encoded data
+ * @param srcLen   encoded data length
+ * @param dst      decoded video data
+ * @param dstSize  size of the dst buffer
+ *
+ * @return decoded length, -1 if the data is corrupted or does not fit in dst
+ */
+int rleDecode(const char *src, int srcLen, char *dst, int dstSize);
+
+/**
+ * Method to build one fragment of a frame, ready for sendmsg. The data is
+ * run-length encoded in data->data if codec is CODEC_RLE and the encoded data
+ * is not larger than the raw data. Otherwise the raw video data is not
+ * copied, iov[1] points to src.
+ * The CODEC field of data->options is set to the codec used.
+ *
+ * @param data   fragment header, options already built
+ * @param src    video data of the fragment
+ * @param size   video data length (<= MSG_MAX_SIZE)
+ * @param codec  CODEC_RAW or CODEC_RLE
+ * @param iov    2 entries filled : header (and encoded data), raw data
+ *
+ * @return size of the datagram to send
+ */
+size_t buildFragment(struct SERVER_DATA *data, const char *src, int size, unsigned int codec, struct iovec iov[2]);
+
+/**
+ * Method to get the data size of the fragments for a path MTU : the largest
+ * datagram the path carries without IP fragmentation
+ *
+ * @param mtu  path MTU, 0 if unknown
+ *
+ * @return fragment data size, MSG_SIZE to MSG_MAX_SIZE
+ */
+int fragmentPayload(int mtu);
+
+/**
+ * Method to get the MTU of the path to an address, from the route the
+ * kernel would use
+ *
+ * @param to  destination
+ *
+ * @return path MTU, 0 if unknown
+ */
+int getPathMtu(const struct sockaddr_in *to);
+
+/**
+ * Method to send several datagrams of the same size to one destination with
+ * one call : the kernel splits the data in segments of segment bytes (UDP
+ * generic segmentation offload), the last one may be shorter.
+ *
+ * @param s        UDP socket
+ * @param to       destination
+ * @param iov      data of the datagrams, one after the other
+ * @param iovlen   number of iov entries
+ * @param segment  datagram size
+ *
+ * @return bytes sent, -1 on error (errno set, EIO or EINVAL if the kernel has no UDP GSO)
+ */
+int sendSegments(int s, const struct sockaddr_in *to, struct iovec *iov, int iovlen, int segment);
+
+/**
+ * Method to hash video data, used to detect unchanged frames and rows. Four
+ * independent 64 bit lanes are mixed per 32 bytes block so the multiplies
+ * overlap. Scalar : neither NEON nor SSE2 multiply 64 bit lanes, and 32 bit
+ * vector lanes lose on rows (bench -b hash). Not a cryptographic hash.
+ *
+ * @param buf  video data
+ * @param len  video data length
+ *
+ * @return 64 bit hash
+ */
+uint64_t hashBuffer(const char *buf, int len);
+
+/**
+ * Method to compute a keyed hash (SipHash-2-4), for the values a remote
+ * peer must not be able to forge without the key
+ *
+ * @param key  128 bit secret key
+ * @param buf  data
+ * @param len  data length
+ *
+ * @return 64 bit hash
+ */
+uint64_t sipHash(const uint64_t key[2], const char *buf, int len);
+
+/**
+ * Method to get the FIFO path of a channel : FIFO_PATH for channel 0,
+ * FIFO_PATH followed by the channel number for the others
+ *
+ * @param channel  channel number
+ * @param path     FIFO path
+ * @param size     size of the path buffer
+ */
+void getFifoPath(unsigned int channel, char *path, int size);
+
+/**
+ * Method to get the geometry of a text frame from its content, for the
+ * frames without geometry in their header (archive, time-shift ring)
+ *
+ * @param text     frame text, rows ending with '\n'
+ * @param length   frame length
+ * @param columns  characters per row, '\n' excluded
+ * @param rows     number of rows
+ */
+void getTextGeometry(const char *text, int length, uint16_t *columns, uint16_t *rows);
+
+/**
+ * Method to paint a colour frame : its text with the escape sequences of the
+ * cell colours, written only when the colour changes
+ *
+ * @param text     frame text, rows ending with '\n'
+ * @param textLen  text length
+ * @param runs     colour runs following the text in the frame
+ * @param runsLen  colour runs length
+ * @param colour   COLOUR_256 or COLOUR_TRUE
+ * @param dst      text with escapes
+ * @param dstSize  dst size, the painting stops when it is full
+ *
+ * @return number of bytes written in dst
+ */
+int colourPaint(const char *text, int textLen, const unsigned char *runs, int runsLen, unsigned int colour, char *dst, int dstSize);
+
 
 
 #endif
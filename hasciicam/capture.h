@@ -0,0 +1,430 @@
+/*  HasciiCam 1.3
+ *
+ *  (c) 2000-2014 Denis Roio <jaromil@dyne.org>
+ *
+ * This source code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This source code is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Please refer to the GNU Public License for more details.
+ *
+ * You should have received a copy of the GNU Public License along with
+ * this source code; if not, write to:
+ * Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+// *****************************************************************************
+//   HEIA-FR ,  Embedded Systems 3 ,  TP04 - Hasciicam ,  Vallelian & Waeber
+// *****************************************************************************
+//   V4L2 streaming capture of hasciicam, header only like convert.h so
+//   that the server runs the same capture in its own threads (server_capture).
+//   Errors are returned with a message in error[], nothing exits.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/types.h>
+#include <linux/udmabuf.h>
+#include <linux/videodev2.h>
+
+#define CAPTURE_BUFFERS 32   /* driver buffers at most */
+
+#ifndef MFD_ALLOW_SEALING     /* memfd and seals, for C libraries without them */
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS   1033
+#define F_SEAL_SHRINK 0x0002
+#endif
+
+/* what is asked to the driver */
+struct capture_config {
+    int          width, height;         /* grab size, 0 for the driver default */
+    int          min_width, min_height; /* smallest size still covering the picture, 0 to grab at width x height */
+    unsigned int pixelformat;           /* V4L2_PIX_FMT_GREY or V4L2_PIX_FMT_YUYV, YUYV if the driver lacks it */
+    unsigned int buffers;               /* buffers requested, CAPTURE_BUFFERS at most */
+    unsigned int memory;                /* V4L2_MEMORY_MMAP, _USERPTR or _DMABUF : the driver fills our pool */
+};
+
+struct capture_device {
+    int                    fd;
+    unsigned int           count;          /* buffers granted */
+    unsigned int           memory;         /* V4L2_MEMORY_* granted */
+    struct {
+        void  *start;
+        size_t length;
+        int    dmabuf;                     /* udmabuf over the pool (DMABUF), -1 otherwise */
+    }                      buffers[CAPTURE_BUFFERS];
+    unsigned char         *pool;           /* buffers of our own (USERPTR, DMABUF), NULL with MMAP */
+    size_t                 pool_size;
+    int                    memfd;          /* pool memory shared with udmabuf (DMABUF), -1 otherwise */
+    struct v4l2_buffer     buffer;         /* last buffer dequeued */
+    uint32_t               sequence;       /* driver sequence of the last buffer dequeued */
+    int                    sequenced;      /* sequence valid */
+    unsigned int           skipped;        /* frames lost before the last buffer dequeued : driver drops, corrupted buffers */
+    struct v4l2_capability capability;
+    struct v4l2_input      input;
+    struct v4l2_format     format;         /* GREY or YUYV, width and height granted */
+    char                   error[128];     /* reason of the last failure */
+};
+
+
+/* name of a V4L2_MEMORY_* */
+static inline const char *capture_memory_name(unsigned int memory) {
+    return (memory == V4L2_MEMORY_USERPTR) ? "userptr" : (memory == V4L2_MEMORY_DMABUF) ? "dmabuf" : "mmap";
+}
+
+/* release the buffers and the device, the structure can be opened again */
+static inline void capture_close(struct capture_device *cap) {
+    int buftype = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    unsigned int i;
+    if(cap->fd < 0) return;
+    ioctl(cap->fd, VIDIOC_STREAMOFF, &buftype);
+    for(i=0; i<cap->count; i++)
+        if(cap->pool == NULL) munmap(cap->buffers[i].start, cap->buffers[i].length);
+    /* every slot: capture_pool may fail with udmabufs made before cap->count is set */
+    for(i=0; i<CAPTURE_BUFFERS; i++) {
+        if(cap->buffers[i].dmabuf >= 0) close(cap->buffers[i].dmabuf);
+        cap->buffers[i].dmabuf = -1;
+    }
+    cap->count = 0;
+    close(cap->fd);
+    cap->fd = -1;
+    if(cap->pool != NULL) munmap(cap->pool, cap->pool_size);
+    cap->pool = NULL;
+    if(cap->memfd >= 0) close(cap->memfd);
+    cap->memfd = -1;
+}
+
+static inline int capture_fail(struct capture_device *cap, const char *what) {
+    snprintf(cap->error, sizeof(cap->error), "%s: %s", what, strerror(errno));
+    capture_close(cap);
+    return -1;
+}
+
+/* hand buffer i to the driver. returns 0, -1 with cap->error set */
+static inline int capture_queue(struct capture_device *cap, unsigned int i) {
+    struct v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = cap->memory;
+    buffer.index  = i;
+    if(cap->memory == V4L2_MEMORY_USERPTR) {
+        buffer.m.userptr = (unsigned long)cap->buffers[i].start;
+        buffer.length    = cap->buffers[i].length;
+    } else if(cap->memory == V4L2_MEMORY_DMABUF) {
+        buffer.m.fd   = cap->buffers[i].dmabuf;
+        buffer.length = cap->buffers[i].length;
+    }
+    if(-1 == ioctl(cap->fd, VIDIOC_QBUF, &buffer)) {
+        snprintf(cap->error, sizeof(cap->error), "VIDIOC_QBUF: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* driver has the pixel format */
+static inline int capture_has_format(struct capture_device *cap, unsigned int pixelformat) {
+    struct v4l2_fmtdesc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    for(desc.index=0; 0 == ioctl(cap->fd, VIDIOC_ENUM_FMT, &desc); desc.index++)
+        if(desc.pixelformat == pixelformat) return 1;
+    return 0;
+}
+
+/* smallest frame size of the driver covering min_width x min_height, in
+   *w and *h. returns 0, -1 if the driver does not list one */
+static inline int capture_smallest_size(struct capture_device *cap, unsigned int pixelformat,
+                                        int min_width, int min_height, int *w, int *h) {
+    struct v4l2_frmsizeenum size;
+    int found = -1;
+    memset(&size, 0, sizeof(size));
+    size.pixel_format = pixelformat;
+    for(size.index=0; 0 == ioctl(cap->fd, VIDIOC_ENUM_FRAMESIZES, &size); size.index++) {
+        if(size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+            int dw = size.discrete.width, dh = size.discrete.height;
+            if((dw >= min_width) && (dh >= min_height) && ((found == -1) || (dw*dh < (*w)*(*h)))) {
+                *w = dw;
+                *h = dh;
+                found = 0;
+            }
+            continue;
+        }
+        /* stepwise or continuous : the min size rounded up to the step */
+        struct v4l2_frmsize_stepwise *sw = &size.stepwise;
+        unsigned int stepw = sw->step_width ? sw->step_width : 1, steph = sw->step_height ? sw->step_height : 1;
+        unsigned int fw = (min_width  > (int)sw->min_width)  ? sw->min_width  + (min_width -sw->min_width +stepw-1)/stepw*stepw : sw->min_width;
+        unsigned int fh = (min_height > (int)sw->min_height) ? sw->min_height + (min_height-sw->min_height+steph-1)/steph*steph : sw->min_height;
+        if((fw > sw->max_width) || (fh > sw->max_height)) return -1;
+        *w = fw;
+        *h = fh;
+        return 0;
+    }
+    return found;
+}
+
+/* camera buffers in one block of our own : the driver writes in it
+   (USERPTR) or in udmabufs over it (DMABUF). returns 0, -1 */
+static inline int capture_pool(struct capture_device *cap, unsigned int count, size_t length, unsigned int memory) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    unsigned int i;
+    length         = (length+page-1)/page*page;
+    cap->pool_size = (size_t)count*length;
+    if(memory == V4L2_MEMORY_DMABUF) {
+        struct udmabuf_create create;
+        int dev;
+        cap->memfd = syscall(SYS_memfd_create, "capture", MFD_ALLOW_SEALING);
+        if((cap->memfd == -1) || (-1 == ftruncate(cap->memfd, cap->pool_size)) ||
+           (-1 == fcntl(cap->memfd, F_ADD_SEALS, F_SEAL_SHRINK))) return -1;
+        cap->pool = (unsigned char*)mmap(NULL, cap->pool_size, PROT_READ | PROT_WRITE, MAP_SHARED, cap->memfd, 0);
+        if(MAP_FAILED == cap->pool) {
+            cap->pool = NULL;
+            return -1;
+        }
+        dev = open("/dev/udmabuf", O_RDWR);
+        if(dev == -1) return -1;
+        for(i=0; i<count; i++) {
+            memset(&create, 0, sizeof(create));
+            create.memfd  = cap->memfd;
+            create.flags  = UDMABUF_FLAGS_CLOEXEC;
+            create.offset = (size_t)i*length;
+            create.size   = length;
+            cap->buffers[i].dmabuf = ioctl(dev, UDMABUF_CREATE, &create);
+            if(cap->buffers[i].dmabuf == -1) break;
+        }
+        close(dev);
+        if(i < count) return -1;
+    } else {
+        cap->pool = (unsigned char*)mmap(NULL, cap->pool_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(MAP_FAILED == cap->pool) {
+            cap->pool = NULL;
+            return -1;
+        }
+    }
+    for(i=0; i<count; i++) {
+        cap->buffers[i].start  = cap->pool + (size_t)i*length;
+        cap->buffers[i].length = length;
+    }
+    return 0;
+}
+
+/* open a device as config asks, fill its buffers and start streaming.
+   USERPTR or DMABUF falls back to MMAP when the driver or the kernel do
+   not have it. returns 0, -1 with cap->error set */
+static inline int capture_open_config(struct capture_device *cap, const char *device,
+                                      int input, const struct capture_config *config) {
+    struct v4l2_requestbuffers reqbuf;
+    int buftype = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    unsigned int i, pixelformat = config->pixelformat;
+    int w = config->width, h = config->height;
+
+    memset(cap, 0, sizeof(*cap));
+    cap->memfd = -1;
+    for(i=0; i<CAPTURE_BUFFERS; i++) cap->buffers[i].dmabuf = -1;
+    cap->fd = open(device, O_RDWR | O_NONBLOCK);
+    if(cap->fd == -1) return capture_fail(cap, device);
+
+    // Check that streaming is supported
+    if(-1 == ioctl(cap->fd, VIDIOC_QUERYCAP, &cap->capability))
+        return capture_fail(cap, "VIDIOC_QUERYCAP");
+    if(((cap->capability.capabilities & V4L2_CAP_VIDEO_CAPTURE) == 0) ||
+       ((cap->capability.capabilities & V4L2_CAP_STREAMING) == 0)) {
+        errno = ENOTSUP;
+        return capture_fail(cap, "no video streaming capture");
+    }
+
+    // Switch to the selected video input
+    if(-1 == ioctl(cap->fd, VIDIOC_S_INPUT, &input))
+        return capture_fail(cap, "VIDIOC_S_INPUT");
+    cap->input.index = input;
+    if(-1 == ioctl(cap->fd, VIDIOC_ENUMINPUT, &cap->input))
+        return capture_fail(cap, "VIDIOC_ENUMINPUT");
+
+    // GREY is the luminance alone, YUYV has it every other byte
+    if(!capture_has_format(cap, pixelformat)) pixelformat = V4L2_PIX_FMT_YUYV;
+    if((config->min_width > 0) && (config->min_height > 0))
+        capture_smallest_size(cap, pixelformat, config->min_width, config->min_height, &w, &h);
+    cap->format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if(-1 == ioctl(cap->fd, VIDIOC_G_FMT, &cap->format))
+        return capture_fail(cap, "VIDIOC_G_FMT");
+    cap->format.fmt.pix.pixelformat = pixelformat;
+    if((w > 0) && (h > 0)) {
+        cap->format.fmt.pix.width  = w;
+        cap->format.fmt.pix.height = h;
+    }
+    if(-1 == ioctl(cap->fd, VIDIOC_S_FMT, &cap->format))
+        return capture_fail(cap, "VIDIOC_S_FMT");
+    if((cap->format.fmt.pix.pixelformat != V4L2_PIX_FMT_GREY) && (cap->format.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV)) {
+        errno = ENOTSUP;
+        return capture_fail(cap, "no GREY or YUYV format");
+    }
+
+    memset(&reqbuf, 0, sizeof(reqbuf));
+    reqbuf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    reqbuf.memory = config->memory;
+    reqbuf.count  = ((config->buffers > 0) && (config->buffers < CAPTURE_BUFFERS)) ? config->buffers : CAPTURE_BUFFERS;
+    if((reqbuf.memory != V4L2_MEMORY_MMAP) && (-1 == ioctl(cap->fd, VIDIOC_REQBUFS, &reqbuf))) {
+        reqbuf.memory = V4L2_MEMORY_MMAP;
+        reqbuf.count  = ((config->buffers > 0) && (config->buffers < CAPTURE_BUFFERS)) ? config->buffers : CAPTURE_BUFFERS;
+    }
+    if((reqbuf.memory == V4L2_MEMORY_MMAP) && (-1 == ioctl(cap->fd, VIDIOC_REQBUFS, &reqbuf)))
+        return capture_fail(cap, "VIDIOC_REQBUFS");
+    if(reqbuf.count > CAPTURE_BUFFERS) reqbuf.count = CAPTURE_BUFFERS;
+
+    // Pool of our own, MMAP if the kernel cannot share it with the driver
+    if((reqbuf.memory != V4L2_MEMORY_MMAP) &&
+       (capture_pool(cap, reqbuf.count, cap->format.fmt.pix.sizeimage, reqbuf.memory) == -1)) {
+        capture_close(cap);
+        struct capture_config mmap_config = *config;
+        mmap_config.memory = V4L2_MEMORY_MMAP;
+        return capture_open_config(cap, device, input, &mmap_config);
+    }
+    cap->memory = reqbuf.memory;
+
+    for(i=0; i<reqbuf.count; i++) {
+        memset(&cap->buffer, 0, sizeof(cap->buffer));
+        cap->buffer.type   = reqbuf.type;
+        cap->buffer.memory = reqbuf.memory;
+        cap->buffer.index  = i;
+        if(reqbuf.memory == V4L2_MEMORY_MMAP) {
+            if(-1 == ioctl(cap->fd, VIDIOC_QUERYBUF, &cap->buffer))
+                return capture_fail(cap, "VIDIOC_QUERYBUF");
+            cap->buffers[i].length = cap->buffer.length;
+            cap->buffers[i].start  = mmap(NULL, cap->buffer.length, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED, cap->fd, cap->buffer.m.offset);
+            if(MAP_FAILED == cap->buffers[i].start)
+                return capture_fail(cap, "mmap");
+        }
+        cap->count++;
+        if(-1 == capture_queue(cap, i)) {
+            capture_close(cap);
+            return -1;
+        }
+    }
+
+    if(-1 == ioctl(cap->fd, VIDIOC_STREAMON, &buftype))
+        return capture_fail(cap, "VIDIOC_STREAMON");
+    return 0;
+}
+
+/* open a device in YUYV at w x h (0 for the driver default), map its
+   buffers and start streaming. returns 0, -1 with cap->error set */
+static inline int capture_open(struct capture_device *cap, const char *device,
+                               int input, int w, int h) {
+    struct capture_config config;
+    memset(&config, 0, sizeof(config));
+    config.width       = w;
+    config.height      = h;
+    config.pixelformat = V4L2_PIX_FMT_YUYV;
+    config.buffers     = CAPTURE_BUFFERS;
+    config.memory      = V4L2_MEMORY_MMAP;
+    return capture_open_config(cap, device, input, &config);
+}
+
+/* stop streaming, the device and its buffers stay ready for
+   capture_resume. the driver takes every buffer back */
+static inline void capture_pause(struct capture_device *cap) {
+    int buftype = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if(cap->fd < 0) return;
+    ioctl(cap->fd, VIDIOC_STREAMOFF, &buftype);
+    cap->sequenced = 0;
+}
+
+/* queue every buffer again and restart streaming after capture_pause.
+   returns 0, -1 with cap->error set (the device is left open) */
+static inline int capture_resume(struct capture_device *cap) {
+    int buftype = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    unsigned int i;
+    for(i=0; i<cap->count; i++)
+        if(-1 == capture_queue(cap, i)) return -1;
+    if(-1 == ioctl(cap->fd, VIDIOC_STREAMON, &buftype)) {
+        snprintf(cap->error, sizeof(cap->error), "VIDIOC_STREAMON: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* give the last buffer dequeued back to the driver. returns 0, -1 */
+static inline int capture_requeue(struct capture_device *cap) {
+    if(-1 == ioctl(cap->fd, VIDIOC_QBUF, &cap->buffer)) {
+        snprintf(cap->error, sizeof(cap->error), "VIDIOC_QBUF: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* wait up to timeout_ms (-1 forever) for the next frame. returns the
+   image, NULL with cap->error set (errno ETIMEDOUT if no frame came in
+   time). capture_us gets the exposure time (CLOCK_MONOTONIC, us), now_us
+   if the driver does not give a monotonic timestamp. cap->skipped counts
+   the frames lost since the previous one */
+static inline const unsigned char *capture_dequeue(struct capture_device *cap, uint64_t now_us,
+                                                   uint64_t *capture_us, int timeout_ms) {
+    struct pollfd pfd;
+    cap->skipped = 0;
+    while(1) {
+        memset(&cap->buffer, 0, sizeof(cap->buffer));
+        cap->buffer.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        cap->buffer.memory = cap->memory;
+        if(0 == ioctl(cap->fd, VIDIOC_DQBUF, &cap->buffer)) {
+            // A corrupted frame is lost, its buffer goes back
+            if(cap->buffer.flags & V4L2_BUF_FLAG_ERROR) {
+                cap->skipped++;
+                if(-1 == capture_requeue(cap)) return NULL;
+                continue;
+            }
+            break;
+        }
+        if(errno == EINTR) continue;
+        if(errno != EAGAIN) {
+            snprintf(cap->error, sizeof(cap->error), "VIDIOC_DQBUF: %s", strerror(errno));
+            return NULL;
+        }
+        pfd.fd      = cap->fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, timeout_ms);
+        if((ready == -1) && (errno != EINTR)) {
+            snprintf(cap->error, sizeof(cap->error), "poll: %s", strerror(errno));
+            return NULL;
+        }
+        if(ready == 0) {
+            snprintf(cap->error, sizeof(cap->error), "no frame for %i ms", timeout_ms);
+            errno = ETIMEDOUT;
+            return NULL;
+        }
+        if((ready == 1) && (pfd.revents & POLLERR) && !(pfd.revents & POLLIN)) {
+            snprintf(cap->error, sizeof(cap->error), "device error");
+            errno = EIO;
+            return NULL;
+        }
+    }
+    if(cap->sequenced && ((uint32_t)(cap->buffer.sequence - cap->sequence - 1) < 0x10000))
+        cap->skipped += cap->buffer.sequence - cap->sequence - 1;
+    cap->sequence  = cap->buffer.sequence;
+    cap->sequenced = 1;
+    if((cap->buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+        *capture_us = (uint64_t)cap->buffer.timestamp.tv_sec*1000000 + cap->buffer.timestamp.tv_usec;
+    else
+        *capture_us = now_us;
+    return (const unsigned char*)cap->buffers[cap->buffer.index].start;
+}
+
+#endif
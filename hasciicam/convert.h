@@ -0,0 +1,274 @@
+/*  HasciiCam 1.3
+ *
+ *  (c) 2000-2014 Denis Roio <jaromil@dyne.org>
+ *
+ * This source code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This source code is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Please refer to the GNU Public License for more details.
+ *
+ * You should have received a copy of the GNU Public License along with
+ * this source code; if not, write to:
+ * Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <string.h>
+
+// *****************************************************************************
+//   HEIA-FR ,  Embedded Systems 3 ,  TP04 - Hasciicam ,  Vallelian & Waeber
+// *****************************************************************************
+//   Image kernels of hasciicam, header only so that the benchmarks (bench/)
+//   run exactly the code of the capture loop.
+
+/* native renderer ramp, darkest to brightest */
+#define ASCII_RAMP " .:-=+*#%@"
+#define ASCII_RAMP_LEN 10
+
+
+/* sample the Y luminance of a YUYV frame, hopping over the pixels */
+static inline void yuv422_to_grey(const unsigned char *src, unsigned char *dst,
+                                  int gw, int gh, int xbytestep, int ybytestep) {
+    const unsigned char *readhead = src;
+    unsigned char *writehead = dst;
+    int x, y;
+    for(y=0; y<gh; ++y){
+        for(x=0; x<gw; ++x){
+            *(writehead++) = *readhead;
+            readhead += xbytestep;
+        }
+        readhead += ybytestep;
+    }
+}
+
+/* native renderer: one character per 2x2 grey block, newline at end of rows.
+   dst must hold (gw/2+1)*(gh/2) bytes, returns the number of bytes written */
+static inline int grey_to_ascii(const unsigned char *grey, char *dst, int gw, int gh) {
+    static const char ramp[] = ASCII_RAMP;
+    int aw = gw/2, ah = gh/2;
+    int x, y;
+    char *out = dst;
+    for(y=0; y<ah; ++y){
+        const unsigned char *r0 = grey + (2*y)*gw;
+        const unsigned char *r1 = r0 + gw;
+        for(x=0; x<aw; ++x){
+            int sum = r0[2*x] + r0[2*x+1] + r1[2*x] + r1[2*x+1];   /* 0..1020 */
+            *(out++) = ramp[(sum*ASCII_RAMP_LEN) >> 10];
+        }
+        *(out++) = '\n';
+    }
+    return out-dst;
+}
+
+/* pyramid level: 2x2 box average of a grey image, dst is (w/2)x(h/2). The
+   levels are built once per frame and every output geometry samples the
+   level closest above it, so that an output only costs its resampling and
+   rendering. */
+static inline void grey_halve(const unsigned char *src, int w, int h, unsigned char *dst) {
+    int hw = w/2, hh = h/2;
+    int x, y;
+    for(y=0; y<hh; ++y){
+        const unsigned char *r0 = src + (2*y)*w;
+        const unsigned char *r1 = r0 + w;
+        unsigned char *out = dst + y*hw;
+        for(x=0; x<hw; ++x)
+            out[x] = (r0[2*x] + r0[2*x+1] + r1[2*x] + r1[2*x+1] + 2) >> 2;
+    }
+}
+
+/* nearest neighbour resampling of a grey image to dw x dh, 16.16 fixed
+   point steps (the pyramid level is at most twice as large, no aliasing) */
+static inline void grey_resample(const unsigned char *src, int sw, int sh,
+                                 unsigned char *dst, int dw, int dh) {
+    unsigned int xstep = ((unsigned int)sw << 16)/dw;
+    unsigned int ystep = ((unsigned int)sh << 16)/dh;
+    unsigned int sy = ystep >> 1;
+    int x, y;
+    for(y=0; y<dh; ++y, sy += ystep){
+        const unsigned char *row = src + (sy >> 16)*sw;
+        unsigned int sx = xstep >> 1;
+        for(x=0; x<dw; ++x, sx += xstep)
+            *(dst++) = row[sx >> 16];
+    }
+}
+
+/* colour of the text cells, from the chroma the grey conversion drops: the
+   U and V of the first YUYV pixel pair sampled for a cell (the chroma is
+   shared by two pixels anyway) with the mean luminance of its 2x2 grey
+   block, converted to RGB (BT.601) and quantized, one byte per cell (xterm
+   256 colour cube, 16 + 36r + 6g + b) or three (truecolour, with
+   COLOUR_TRUE_BITS bits per component so that the runs stay long). The
+   conversion runs in 16 bit (6 bit luma and chroma, enough for the
+   quantization) by blocks of COLOUR_BLOCK cells : loops the compiler
+   vectorizes at -O2 with 16 bit lanes (no branch, the clamps are min/max,
+   fixed trip count). acc holds 3*(aw+COLOUR_BLOCK) shorts. Same sampling
+   arguments as yuv422_to_grey. */
+#define COLOUR_TRUE_BITS 4
+#define COLOUR_BLOCK     16
+
+static inline short colour_clamp(int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static inline void colour_block(const short *ys, const short *us, const short *vs,
+                                unsigned char *out, int truecolour) {
+    short r[COLOUR_BLOCK], g[COLOUR_BLOCK], b[COLOUR_BLOCK];
+    int k;
+    for(k=0; k<COLOUR_BLOCK; ++k){
+        short c = ys[k]*149 - 596;                    /* 1.164 (Y-16), Y 6 bit, 3 fraction bits */
+        r[k] = colour_clamp((short)(c + vs[k]*204) >> 5);
+        g[k] = colour_clamp((short)(c - us[k]*50 - vs[k]*104) >> 5);
+        b[k] = colour_clamp((short)(c + us[k]*258) >> 5);
+    }
+    if(truecolour){
+        for(k=0; k<COLOUR_BLOCK; ++k){
+            out[3*k]   = (r[k] >> (8-COLOUR_TRUE_BITS)) * (255/((1<<COLOUR_TRUE_BITS)-1));
+            out[3*k+1] = (g[k] >> (8-COLOUR_TRUE_BITS)) * (255/((1<<COLOUR_TRUE_BITS)-1));
+            out[3*k+2] = (b[k] >> (8-COLOUR_TRUE_BITS)) * (255/((1<<COLOUR_TRUE_BITS)-1));
+        }
+    }else{
+        for(k=0; k<COLOUR_BLOCK; ++k)
+            out[k] = 16 + 36*((r[k]*6) >> 8) + 6*((g[k]*6) >> 8) + ((b[k]*6) >> 8);
+    }
+}
+
+static inline void yuv422_to_colour(const unsigned char *src, const unsigned char *grey,
+                                    unsigned char *__restrict cells, short *__restrict acc,
+                                    int gw, int gh, int xbytestep, int ybytestep, int truecolour) {
+    int aw = gw/2, ah = gh/2, bpc = truecolour ? 3 : 1;
+    int rowbytes = gw*xbytestep + ybytestep;         /* between two grey rows */
+    short *ys = acc, *us = acc+aw+COLOUR_BLOCK, *vs = acc+2*(aw+COLOUR_BLOCK);
+    unsigned char tail[3*COLOUR_BLOCK];
+    int x, y;
+    for(y=0; y<ah; ++y){
+        const unsigned char *s  = src + (2*y)*rowbytes;
+        const unsigned char *g0 = grey + (2*y)*gw;
+        const unsigned char *g1 = g0 + gw;
+        unsigned char *out = cells + y*aw*bpc;
+        for(x=0; x<aw; ++x){
+            ys[x] = (g0[2*x] + g0[2*x+1] + g1[2*x] + g1[2*x+1]) >> 4;
+            us[x] = (s[(2*x)*xbytestep+1] - 128) >> 2;
+            vs[x] = (s[(2*x)*xbytestep+3] - 128) >> 2;
+        }
+        for(x=0; x+COLOUR_BLOCK<=aw; x+=COLOUR_BLOCK)
+            colour_block(ys+x, us+x, vs+x, out+x*bpc, truecolour);
+        if(x < aw){
+            colour_block(ys+x, us+x, vs+x, tail, truecolour);
+            memcpy(out+x*bpc, tail, (aw-x)*bpc);
+        }
+    }
+}
+
+/* colour runs: the cell colours as (count, colour) pairs, count 1..255 and
+   colour of 1 (256 colour) or 3 bytes (truecolour), row after row. Returns
+   the number of bytes written, -1 if they do not fit in size. */
+static inline int colour_runs(const unsigned char *cells, int n, int truecolour,
+                              unsigned char *dst, int size) {
+    int out = 0;
+    int i = 0;
+    if(!truecolour){
+        while(i < n){
+            int run = 1;
+            while((i+run < n) && (run < 255) && (cells[i+run] == cells[i])) run++;
+            if(out+2 > size) return -1;
+            dst[out++] = run;
+            dst[out++] = cells[i];
+            i += run;
+        }
+        return out;
+    }
+    while(i < n){
+        const unsigned char *c = cells + 3*i;
+        int run = 1;
+        while((i+run < n) && (run < 255) && (c[3*run] == c[0]) && (c[3*run+1] == c[1]) && (c[3*run+2] == c[2])) run++;
+        if(out+4 > size) return -1;
+        dst[out++] = run;
+        dst[out++] = c[0];
+        dst[out++] = c[1];
+        dst[out++] = c[2];
+        i += run;
+    }
+    return out;
+}
+
+/* temporal denoise: recursive average of the grey image, the weight of the
+   new frame grows with the difference so that moving areas are not smeared.
+   acc keeps the filtered image in 8.8 fixed point, seeded with the first
+   frame by grey_denoise_seed. strength 1..7 : weight 1/2^strength in a
+   still area, full weight from DENOISE_MOTION grey levels of difference.
+   Processed by blocks of DENOISE_BLOCK pixels, a loop the compiler
+   vectorizes at -O2 (no branch, fixed trip count). */
+#define DENOISE_MOTION_SHIFT 5                       /* DENOISE_MOTION = 32 */
+#define DENOISE_BLOCK        16
+
+static inline void denoise_pixel(unsigned char *grey, unsigned short *acc, int base) {
+    int d     = (*grey << 8) - *acc;
+    int ad    = (d < 0 ? -d : d) >> 8;
+    int alpha = base + (((256-base)*ad) >> DENOISE_MOTION_SHIFT);
+    int v;
+    if(alpha > 256) alpha = 256;
+    v     = *acc + ((d*alpha) >> 8);
+    *acc  = v;
+    *grey = (v+128) >> 8;
+}
+
+/* first frame of the denoise, taken as is */
+static inline void grey_denoise_seed(const unsigned char *grey, unsigned short *acc, int n) {
+    int i;
+    for(i=0; i<n; ++i)
+        acc[i] = grey[i] << 8;
+}
+
+static inline void grey_denoise(unsigned char *__restrict grey, unsigned short *__restrict acc,
+                                int n, int strength) {
+    int base = 256 >> strength;
+    int i, k;
+    for(i=0; i+DENOISE_BLOCK<=n; i+=DENOISE_BLOCK)
+        for(k=0; k<DENOISE_BLOCK; ++k)
+            denoise_pixel(grey+i+k, acc+i+k, base);
+    for(; i<n; ++i)
+        denoise_pixel(grey+i, acc+i, base);
+}
+
+/* glyph hysteresis on a text frame (aw characters and a newline per row,
+   rendered from a 2aw x 2ah grey image): a cell keeps its previous glyph
+   until the mean of its 2x2 grey block moved by more than hyst since the
+   glyph was set. prev (text frame) and ref (aw*ah) keep the state, zeroed
+   at start. hyst 0 only counts. Returns the number of cells changed. */
+static inline int text_hysteresis(char *text, char *prev, unsigned char *ref,
+                                  const unsigned char *grey, int aw, int ah, int hyst) {
+    int gw = 2*aw;
+    int changed = 0;
+    int x, y;
+    for(y=0; y<ah; ++y){
+        const unsigned char *r0 = grey + (2*y)*gw;
+        const unsigned char *r1 = r0 + gw;
+        char          *t = text + y*(aw+1);
+        char          *p = prev + y*(aw+1);
+        unsigned char *m = ref  + y*aw;
+        for(x=0; x<aw; ++x){
+            int mean = (r0[2*x] + r0[2*x+1] + r1[2*x] + r1[2*x+1]) >> 2;
+            int dm   = mean - m[x];
+            if(t[x] == p[x]) continue;
+            if((hyst > 0) && (p[x] != 0) && ((dm < 0 ? -dm : dm) <= hyst)){
+                t[x] = p[x];
+            }else{
+                p[x] = t[x];
+                m[x] = mean;
+                changed++;
+            }
+        }
+        t[aw] = p[aw] = '\n';
+    }
+    return changed;
+}
+
+#endif
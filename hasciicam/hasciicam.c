@@ -47,12 +47,18 @@
 
 #include <aalib.h>
 
+#include "../data.h"
+#include "../histogram.h"
+#include "capture.h"
+#include "convert.h"
+
 
 // *****************************************************************************
 //   HEIA-FR ,  Embedded Systems 3 ,  TP04 - Hasciicam ,  Vallelian & Waeber
 // *****************************************************************************
-#define FIFO_PATH "/tmp/hasciicamFifo"
-#define FIFO_BUF_SIZE 3204               // video 352x288  / ASCII 88x36
+// FIFO_PATH, FIFO_BUF_SIZE and the FIFO frame header are shared with the server (data.h)
+#define PROM_PATH "/tmp/hasciicam.prom"  // Prometheus text dump of the stage latencies
+#define PROM_PERIOD 1000000              // Prometheus dump period (us)
 
 // *****************************************************************************
 
@@ -82,7 +88,13 @@ char *help =
 " -d --device       video grabbing device     - default /dev/video\n"
 " -i --input        input channel number      - default 1\n"
 " -s --size         ascii image size WxH      - webcam's smallest default\n"
+" -Y --yuyv         grab WxH in YUYV          - default GREY covering the text\n"
+" -k --buffers      driver buffers            - default 4\n"
+" -M --memory       mmap|userptr|dmabuf       - default mmap\n"
 " -o --aafile       dumped file               - default hasciicam.[txt|html]\n"
+" -f --fifo         server FIFO (text mode)   - default /tmp/hasciicamFifo\n"
+" -n --denoise      temporal denoise (1-7)    - default 0 (off)\n"
+" -y --hysteresis   glyph hysteresis (grey)   - default 0 (off)\n"
 " -D --daemon       run in background         - default foregrond\n"
 " -U --uid          setuid (int)              - default current\n"
 " -G --gid          setgid (int)              - default current\n"
@@ -106,7 +118,13 @@ const struct option long_options[] = {
   {"device", required_argument, NULL, 'd'},
   {"input", required_argument, NULL, 'i'},
   {"size", required_argument, NULL, 's'},
+  {"yuyv", no_argument, NULL, 'Y'},
+  {"buffers", required_argument, NULL, 'k'},
+  {"memory", required_argument, NULL, 'M'},
   {"aafile", required_argument, NULL, 'o'},
+  {"fifo", required_argument, NULL, 'f'},
+  {"denoise", required_argument, NULL, 'n'},
+  {"hysteresis", required_argument, NULL, 'y'},
   {"daemon", no_argument, NULL, 'D'},
   {"font-size", required_argument, NULL, 'S'},
   {"font-face", required_argument, NULL, 'a'},
@@ -122,7 +140,7 @@ const struct option long_options[] = {
   {0, 0, 0, 0}
 };
 
-char *short_options = "hHvqm:d:i:s:f:DS:a:r:o:b:c:g:IB:F:O:Q:U:G:";
+char *short_options = "hHvqm:d:i:s:Yk:M:f:n:y:DS:a:r:o:b:c:g:IB:F:O:Q:U:G:";
 
 /* default configuration */
 int quiet = 0;
@@ -152,6 +170,11 @@ char fontface[256];
 int user_w = 0;
 int user_h = 0;
 
+/* what is asked to the driver */
+int native = 1;                     /* GREY at the smallest size covering the text, 0 for YUYV at WxH */
+unsigned int capbuffers = CAPTURE_DRIVER_BUFFERS;
+unsigned int capmemory = V4L2_MEMORY_MMAP;
+
 int uid = -1;
 int gid = -1;
 
@@ -165,6 +188,11 @@ char aatmpfile[256];
 void quitproc (int Sig);
 volatile sig_atomic_t userbreak;
 
+/* demand of the server (SIGUSR1) : DEMAND_STOP, _IDLE or _LIVE */
+void demandproc (int Sig, siginfo_t *info, void *context);
+void wait_demand ();
+volatile sig_atomic_t demand = DEMAND_LIVE;
+
 /* ascii context & html formatting stuff*/
 aa_context *ascii_context;
 struct aa_renderparams *ascii_rndparms;
@@ -195,20 +223,9 @@ struct aa_format hascii_format = {
 };
 
 /* v4l2 (thanks Dan)*/
-int buftype = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-struct v4l2_capability capability;
-struct v4l2_input input;
+struct capture_device cap = { -1 };
 struct v4l2_standard standard;
-struct v4l2_format format;
-struct v4l2_requestbuffers reqbuf;
-struct v4l2_buffer buffer;
-struct {
-    void *start;
-    size_t length;
-} *buffers;
 
-
-int fd = -1;
 /* greyscale image is sampled from Y luminance component */
 unsigned char *grey;
 int YtoRGB[256];
@@ -221,6 +238,8 @@ int vw, vh; // video w and h
 int aw, ah; // ascii w and h
 unsigned int greysize;
 int vbytesperline;
+unsigned int vpixelformat;
+int timeouts = 0; // dequeue timeouts in a row, the device is reopened after CAPTURE_TIMEOUTS
 
 
 
@@ -239,107 +258,123 @@ int vbytesperline;
 //   HEIA-FR ,  Embedded Systems 3 ,  TP04 - Hasciicam ,  Vallelian & Waeber
 // *****************************************************************************
 int   fifo_fd;               // FIFO file descriptor
+char  fifo_path[256] = FIFO_PATH;  // FIFO of the server channel fed
 char *fifo_buf;              // Read text file buffer
 FILE *aafile_fd;             // Hasciicam text file
+struct FIFO_FRAME_HEADER *fifo_header;   // Frame header, in front of the text in fifo_buf
+uint64_t capture_us;         // V4L2 timestamp of the last dequeued buffer (CLOCK_MONOTONIC, us)
+int   fifo_direct = 0;       // TEXT mode to the FIFO : render in place, no aafile round trip
+int   skip_render = 0;       // nobody watching : the frame is given back without render nor write
+uint64_t idle_next_us = 0;   // next frame rendered while nobody watches (CLOCK_MONOTONIC, us)
+int   grey_direct = 0;       // grey image converted directly in aa_image
+unsigned long copy_bytes;    // bytes copied between intermediate frame buffers
+int   denoise    = 0;        // temporal denoise strength (1-7), 0 off
+int   hysteresis = 0;        // glyph hysteresis (grey levels), 0 off
+unsigned short *denoise_acc; // filtered grey image (8.8 fixed point)
+int denoise_seeded = 0;      // denoise_acc holds a frame
+char          *hyst_prev;    // last text frame written, for the hysteresis
+unsigned char *hyst_ref;     // block mean when each glyph was set
+unsigned long  cells_changed;// text cells changed between two frames written
 int   nbBytes;               // Number of bytes read/write from/to file/FIFO
 
+/* per stage latencies, written by the capture loop only */
+struct HISTOGRAM hist_dequeue;   // VIDIOC_DQBUF
+struct HISTOGRAM hist_convert;   // YUV422_to_grey
+struct HISTOGRAM hist_denoise;   // temporal denoise of the grey image
+struct HISTOGRAM hist_render;    // aalib fast render of the grabbed frame
+struct HISTOGRAM hist_file;      // aalib render and flush to the aafile, when not fifo_direct
+struct HISTOGRAM hist_fifo;      // aafile copy to the FIFO
+unsigned long    frames_grabbed; // frames dequeued
+unsigned long    frames_written; // frames written to the FIFO
+uint64_t         last_prom_dump; // last Prometheus dump (us)
+
+void prom_dump() {
+    FILE *f = fopen(PROM_PATH ".tmp", "w");
+    if(f == NULL) return;
+    fprintf(f, "# TYPE hasciicam_frames_grabbed_total counter\nhasciicam_frames_grabbed_total %lu\n", frames_grabbed);
+    fprintf(f, "# TYPE hasciicam_frames_written_total counter\nhasciicam_frames_written_total %lu\n", frames_written);
+    fprintf(f, "# TYPE hasciicam_copy_bytes_total counter\nhasciicam_copy_bytes_total %lu\n", copy_bytes);
+    fprintf(f, "# TYPE hasciicam_cells_changed_total counter\nhasciicam_cells_changed_total %lu\n", cells_changed);
+    fprintf(f, "# TYPE hasciicam_stage_latency_us summary\n");
+    histWritePrometheus(f, "hasciicam_stage_latency_us", "stage=\"dequeue\"", &hist_dequeue);
+    histWritePrometheus(f, "hasciicam_stage_latency_us", "stage=\"convert\"", &hist_convert);
+    histWritePrometheus(f, "hasciicam_stage_latency_us", "stage=\"denoise\"", &hist_denoise);
+    histWritePrometheus(f, "hasciicam_stage_latency_us", "stage=\"render\"", &hist_render);
+    histWritePrometheus(f, "hasciicam_stage_latency_us", "stage=\"file_render\"", &hist_file);
+    histWritePrometheus(f, "hasciicam_stage_latency_us", "stage=\"fifo_write\"", &hist_fifo);
+    fclose(f);
+    rename(PROM_PATH ".tmp", PROM_PATH);
+}
 
 
-void YUV422_to_grey(unsigned char *src, unsigned char *dst, int w, int h) {
-    unsigned char *writehead, *readhead;
-    int x,y;
-    writehead = dst;
-    readhead  = src;
-    for(y=0; y<gh; ++y){
-        for(x=0; x<gw; ++x){
-            *(writehead++) = *readhead;
-            readhead += xbytestep;
-        }
-        readhead += ybytestep;
+
+void YUV422_to_grey(const unsigned char *src, unsigned char *dst, int w, int h) {
+    yuv422_to_grey(src, dst, gw, gh, xbytestep, ybytestep);
+}
+
+/* copy the rendered text of aalib in dst, one line per row: the only copy
+   of the text between aalib and the FIFO. returns the number of bytes */
+int text_frame(char *dst, int size) {
+    const unsigned char *text = aa_text(ascii_context);
+    int sw = aa_scrwidth(ascii_context);
+    int sh = aa_scrheight(ascii_context);
+    int row;
+    char *out = dst;
+    for(row = 0; (row < sh) && ((out-dst)+sw+1 <= size); row++) {
+        memcpy(out, text+row*sw, sw);
+        out += sw;
+        *(out++) = '\n';
     }
+    copy_bytes += out-dst;
+    return out-dst;
+}
+
+/* open the device: GREY at the smallest size still covering the grey
+   image of WxH when the driver has it, YUYV at WxH otherwise.
+   returns 0, -1 with cap.error set */
+int vid_open(char *devfile) {
+    struct capture_config config;
+    int grey_native = native && whchanged;
+
+    memset(&config, 0, sizeof(config));
+    config.width       = whchanged ? user_w : 0;
+    config.height      = whchanged ? user_h : 0;
+    config.min_width   = grey_native ? user_w / xstep : 0;
+    config.min_height  = grey_native ? user_h / ystep : 0;
+    config.pixelformat = grey_native ? V4L2_PIX_FMT_GREY : V4L2_PIX_FMT_YUYV;
+    config.buffers     = capbuffers;
+    config.memory      = capmemory;
+    return capture_open_config(&cap, devfile, inputch, &config);
 }
 
 int vid_detect(char *devfile) {
-    int errno;
-    unsigned int i;
 
-    if (-1 == (fd = open(devfile,O_RDWR|O_NONBLOCK))) {
-        perror("!! error in opening video capture device: ");
+    if(vid_open(devfile) == -1) {
+        fprintf(stderr, "!! error in opening video capture device %s (%s)\n", devfile, cap.error);
         return -1;
-    } else {
-        close(fd);
-        fd = open(devfile,O_RDWR);
-    }
-
-// Check that streaming is supported
-    memset(&capability, 0, sizeof(capability));
-    if(-1 == ioctl(fd, VIDIOC_QUERYCAP, &capability)) {
-	perror("VIDIOC_QUERYCAP");
-	exit(EXIT_FAILURE);
-    }
-    if((capability.capabilities & V4L2_CAP_VIDEO_CAPTURE) == 0){
-	printf("Fatal: Device %s does not support video capture\n", capability.card);
-	exit(EXIT_FAILURE);
-    }
-    if((capability.capabilities & V4L2_CAP_STREAMING) == 0){
-	printf("Fatal: Device %s does not support streaming data capture\n", capability.card);
-	exit(EXIT_FAILURE);
     }
 
     fprintf(stderr,"Device detected is %s\n",devfile);
-    fprintf(stderr,"Card name: %s\n",capability.card);
-
-// Switch to the selected video input
-    if(-1 == ioctl(fd, VIDIOC_S_INPUT, &inputch)) {
-	perror("VIDIOC_S_INPUT");
-	exit(EXIT_FAILURE);
-    }
-
-// Get info about current video input
-    memset(&input, 0, sizeof(input));
-    input.index = inputch;
-    if(-1 == ioctl(fd, VIDIOC_ENUMINPUT, &input)) {
-	perror("VIDIOC_ENUMINPUT");
-	exit(EXIT_FAILURE);
-    }
-    printf("Current input is %s\n", input.name);
+    fprintf(stderr,"Card name: %s\n",cap.capability.card);
+    printf("Current input is %s\n", cap.input.name);
 // example 1-6
     memset(&standard, 0, sizeof(standard));
     standard.index = 0;
-    while(0 == ioctl (fd, VIDIOC_ENUMSTD, &standard)){
-	if(standard.id & input.std)
+    while(0 == ioctl (cap.fd, VIDIOC_ENUMSTD, &standard)){
+	if(standard.id & cap.input.std)
             printf("   - %s\n", standard.name);
 	standard.index++;
     }
-// Need to find out (request?) specific data format (sec 1.10.1)
-    memset(&format, 0, sizeof(format));
-    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    /* the format.fmt.pix member, a v4l2_pix_format, is now filled in
-       with default falues */
-    if(-1 == ioctl(fd, VIDIOC_G_FMT, &format)) {
-      perror("VIDIOC_G_FMT");
-      exit(EXIT_FAILURE);
-    }
-
-    format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
 
-    if(whchanged==1) {
-    // fill in user defined values
+    if(whchanged==1)
      fprintf(stderr,"user defined size: %u x %u\n", user_w, user_h);
-     format.fmt.pix.width  = user_w;
-     format.fmt.pix.height = user_h;
-    }
-
-    if(-1 == ioctl(fd, VIDIOC_S_FMT, &format)) {
-      perror("VIDIOC_S_FMT");
-      exit(EXIT_FAILURE);
-    }
 
     printf("Current capture is %u x %u\n",
-           format.fmt.pix.width, format.fmt.pix.height);
+           cap.format.fmt.pix.width, cap.format.fmt.pix.height);
     printf("format %4.4s, %u bytes-per-line\n",
-           (char*)&format.fmt.pix.pixelformat,
-           format.fmt.pix.bytesperline);
+           (char*)&cap.format.fmt.pix.pixelformat,
+           cap.format.fmt.pix.bytesperline);
+    printf("%u capture buffers (%s)\n", cap.count, capture_memory_name(cap.memory));
 
     return 1;
 }
@@ -349,123 +384,105 @@ int vid_init() {
     int i, j;
 
     // TODO QUAA
-    vw = format.fmt.pix.width;
-    vh = format.fmt.pix.height;
-    vbytesperline = format.fmt.pix.bytesperline;
-    xbytestep = xstep + xstep; // for YUV422. for other formats may differ
-    ybytestep = vbytesperline * (ystep-1);
-    // we shrink our pixels crudely, by hopping over them:
-    gw = vw / xstep;
-    gh = vh / ystep;
+    vw = cap.format.fmt.pix.width;
+    vh = cap.format.fmt.pix.height;
+    vbytesperline = cap.format.fmt.pix.bytesperline;
+    vpixelformat = cap.format.fmt.pix.pixelformat;
+    // we shrink our pixels crudely, by hopping over them: the grey image of
+    // WxH, or of the size granted when it is not covered
+    gw = whchanged ? user_w / xstep : 0;
+    gh = whchanged ? user_h / ystep : 0;
+    if ((gw == 0) || (gh == 0) || (vw < gw) || (vh < gh)) {
+        gw = vw / xstep;
+        gh = vh / ystep;
+    }
+    xstep = vw / gw;
+    ystep = vh / gh;
+    // GREY pixels are one byte, YUYV two
+    xbytestep = ((vpixelformat == V4L2_PIX_FMT_GREY) ? 1 : 2) * xstep;
+    ybytestep = vbytesperline * ystep - gw * xbytestep;
     // aalib converts every block of 4 pixels to one character, so our sizes shrink by 2:
     aw = gw / 2;
     ah = gh / 2;
 
     greysize = gw * gh;
     grey = malloc(greysize); // To get grey from YUYV we simply ignore the U and V bytes
+    if(denoise > 0) denoise_acc = calloc(greysize, sizeof(unsigned short));
     printf("Grey buffer is %u bytes\n", greysize);
     for (j=0; j< 256; ++j)
         YtoRGB[j] = 1.164*(j-256);
 
-    memset (&reqbuf, 0, sizeof (reqbuf));
-    reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    reqbuf.memory = V4L2_MEMORY_MMAP;
-    reqbuf.count = 32;
-
-    if (-1 == ioctl (fd, VIDIOC_REQBUFS, &reqbuf)) {
-        if (errno == EINVAL)
-            printf ("Fatal: Video capturing by mmap-streaming is not supported\n");
-        else
-            perror ("VIDIOC_REQBUFS");
-
-        exit (EXIT_FAILURE);
-    }
-    buffers = calloc (reqbuf.count, sizeof (*buffers));
-    if (buffers == NULL){
-        printf("calloc failure!");
-        exit (EXIT_FAILURE);
-    }
-
-    for (i = 0; i < reqbuf.count; i++) {
-
-        memset (&buffer, 0, sizeof (buffer));
-        buffer.type = reqbuf.type;
-	buffer.memory = V4L2_MEMORY_MMAP;
-        buffer.index = i;
-
-        if (-1 == ioctl (fd, VIDIOC_QUERYBUF, &buffer)) {
-            perror ("VIDIOC_QUERYBUF");
-            exit (EXIT_FAILURE);
-        }
-
-        buffers[i].length = buffer.length; /* remember for munmap() */
-
-        buffers[i].start = mmap (NULL, buffer.length,
-                                 PROT_READ | PROT_WRITE, /* recommended */
-                                 MAP_SHARED,             /* recommended */
-                                 fd, buffer.m.offset);
-
-        if (MAP_FAILED == buffers[i].start) {
-            /* If you do not exit here you should unmap() and free()
-             *                    the buffers mapped so far. */
-            perror ("mmap");
-            exit (EXIT_FAILURE);
-        }
-    }
-/* OK, the memory is mapped, so let's queue up the buffers,
-   next is: turn on streaming, and do the business. */
-
-    for (i = 0; i < reqbuf.count; i++) {
-        // queue up all the buffers for the first time
-        memset (&buffer, 0, sizeof (buffer));
-        buffer.type = reqbuf.type;
-	buffer.memory = V4L2_MEMORY_MMAP;
-        buffer.index = i;
-
-        if (-1 == ioctl (fd, VIDIOC_QBUF, &buffer)) {
-            perror ("VIDIOC_QBUF");
-            exit (EXIT_FAILURE);
-        }
-    }
-
-    // turn on streaming
-    if(-1 == ioctl(fd, VIDIOC_STREAMON, &buftype)) {
-	perror("VIDIOC_STREAMON");
-	exit(EXIT_FAILURE);
-    }
-
-
     for (i = 0; i < greysize; i++) {
 	grey[i] = i % 160; //256;
     }
 }
 
 
-void grab_one () {
+/* reopen the device after a failure, until it grants the geometry the
+   buffers are sized for */
+void vid_recover () {
+    fprintf (stderr, "%s, reopening %s\n", cap.error, device);
+    timeouts = 0;
+    do {
+        capture_close (&cap);
+        usleep (CAPTURE_RETRY_MS*1000);
+    } while ((userbreak < 1) &&
+             ((vid_open (device) == -1) ||
+              (cap.format.fmt.pix.width != vw) || (cap.format.fmt.pix.height != vh) ||
+              (cap.format.fmt.pix.bytesperline != vbytesperline) ||
+              (cap.format.fmt.pix.pixelformat != vpixelformat)));
+}
 
-    // Can we have a buffer please?
-    if (-1 == ioctl (fd, VIDIOC_DQBUF, &buffer)) {
-        perror ("VIDIOC_DQBUF");
-        exit (EXIT_FAILURE);
+/* returns 0, -1 if no frame came */
+int grab_one () {
+    uint64_t t0, t1;
+
+    // Can we have a buffer please? Driver timestamp of the exposure, on the
+    // monotonic clock for most drivers (UVC). A silent camera is waited for
+    // a while, then reopened as a failed one
+    t0 = histNowUs();
+    const unsigned char *yuyv = capture_dequeue(&cap, t0, &capture_us, CAPTURE_TIMEOUT_MS);
+    if (yuyv == NULL) {
+        if ((errno != ETIMEDOUT) || (++timeouts >= CAPTURE_TIMEOUTS)) vid_recover ();
+        return -1;
     }
+    timeouts = 0;
+    t1 = histNowUs();
+    histRecord(&hist_dequeue, t1-t0);
+    frames_grabbed++;
 
-    if((++framenum) == renderhop){
+    if(((++framenum) >= renderhop) && !skip_render){
         framenum=0;
-        YUV422_to_grey(buffers[buffer.index].start, grey, vw, vh);
+        unsigned char *img = grey_direct ? aa_image(ascii_context) : grey;
+        // aalib image has the grey geometry : no grey buffer copy
+        YUV422_to_grey(yuyv, img, vw, vh);
+        t0 = histNowUs();
+        histRecord(&hist_convert, t0-t1);
+
+        // Sensor noise averaged out before the render, still glyphs do not flicker
+        if(denoise_acc != NULL) {
+            if(denoise_seeded) grey_denoise(img, denoise_acc, greysize, denoise);
+            else               grey_denoise_seed(img, denoise_acc, greysize);
+            denoise_seeded = 1;
+            t1 = t0;
+            t0 = histNowUs();
+            histRecord(&hist_denoise, t0-t1);
+        }
+        if(!grey_direct) {
+            memcpy( aa_image(ascii_context), grey, greysize);
+            copy_bytes += greysize;
+        }
 
-        memcpy( aa_image(ascii_context), grey, greysize);
-        aa_fastrender(ascii_context, 0, 0, vw/(xstep*2), vh/(ystep*2)); //TODO are the w&h args correct?
-//		aa_render(ascii_context, ascii_rndparms, 0, 0, vw/(xstep*2), vh/(ystep*2)); //TODO are the w&h args correct?
-        aa_flush(ascii_context);
+        aa_fastrender(ascii_context, 0, 0, aw, ah);
+//		aa_render(ascii_context, ascii_rndparms, 0, 0, aw, ah);
+        if(!fifo_direct) aa_flush(ascii_context);
+        histRecord(&hist_render, histNowUs()-t0);
     }
 
 
     // Thanks for lending us your buffer, you may have it back again:
-    if (-1 == ioctl (fd, VIDIOC_QBUF, &buffer)) {
-        perror ("VIDIOC_QBUF");
-        exit (EXIT_FAILURE);
-    }
-
+    if (-1 == capture_requeue(&cap)) vid_recover ();
+    return 0;
 }
 
 
@@ -528,6 +545,19 @@ config_init (int argc, char *argv[]) {
     case 'd':
       strncpy(device,optarg,256);
       break;
+    case 'f':
+      strncpy(fifo_path,optarg,255);
+      break;
+    case 'n':
+      denoise = atoi (optarg);
+      if ((denoise < 0) || (denoise > 7)) {
+	fprintf (stderr, "invalid denoise strength (1-7)\n");
+	exit (1);
+      }
+      break;
+    case 'y':
+      hysteresis = atoi (optarg);
+      break;
     case 'i':
       inputch = atoi (optarg);
       /*
@@ -557,6 +587,28 @@ config_init (int argc, char *argv[]) {
 	whchanged = 1;
       }
       break;
+    case 'Y':
+      native = 0;
+      break;
+    case 'k':
+      capbuffers = atoi (optarg);
+      if ((capbuffers < 1) || (capbuffers > CAPTURE_BUFFERS)) {
+	fprintf (stderr, "invalid number of buffers, 1 to %i\n", CAPTURE_BUFFERS);
+	exit (1);
+      }
+      break;
+    case 'M':
+      if (strcmp (optarg, "mmap") == 0)
+	capmemory = V4L2_MEMORY_MMAP;
+      else if (strcmp (optarg, "userptr") == 0)
+	capmemory = V4L2_MEMORY_USERPTR;
+      else if (strcmp (optarg, "dmabuf") == 0)
+	capmemory = V4L2_MEMORY_DMABUF;
+      else {
+	fprintf (stderr, "invalid memory, mmap|userptr|dmabuf\n");
+	exit (1);
+      }
+      break;
     case 'S':
       fontsize = atoi (optarg);
       switch (fontsize) {
@@ -623,6 +675,12 @@ main (int argc, char **argv) {
   /* register signal traps */
   if (signal (SIGINT, quitproc) == SIG_ERR) {
       perror ("Couldn't install SIGINT handler"); exit (1); }
+  struct sigaction demand_action;
+  memset (&demand_action, 0, sizeof(demand_action));
+  demand_action.sa_sigaction = demandproc;
+  demand_action.sa_flags     = SA_SIGINFO | SA_RESTART;
+  if (sigaction (SIGUSR1, &demand_action, NULL) == -1) {
+      perror ("Couldn't install SIGUSR1 handler"); exit (1); }
   fprintf (stderr, version, PACKAGE, VERSION);
 
   /* default values */
@@ -742,25 +800,70 @@ main (int argc, char **argv) {
 // *****************************************************************************
 
 // Open the FIFO file to communicate with thread server_thr_send
-fifo_fd = open(FIFO_PATH, O_WRONLY);
+fifo_fd = open(fifo_path, O_WRONLY);
 if(fifo_fd == -1) printf("Unable to open FIFO for writing !\n");
 
-fifo_buf = malloc(FIFO_BUF_SIZE);
+// Frame header and text are written together, the frame geometry follows the aalib screen
+fifo_header = calloc(1, sizeof(struct FIFO_FRAME_HEADER) + FIFO_BUF_SIZE);
+fifo_header->magic = FIFO_MAGIC;
+fifo_header->pid   = getpid();     // the server signals the demand to this process
+fifo_buf = (char*)(fifo_header+1);
+
+fifo_direct = (mode == TEXT) && (fifo_fd != -1);
+
+// Changed cells counted on every frame, glyphs held if hysteresis is set
+if(fifo_direct && (aa_imgwidth(ascii_context) == 2*aa_scrwidth(ascii_context))) {
+  hyst_prev = calloc(1, FIFO_BUF_SIZE);
+  hyst_ref  = calloc(1, FIFO_BUF_SIZE);
+}
+grey_direct = (aa_imgwidth(ascii_context) == gw) && (aa_imgheight(ascii_context) == gh);
 
 // *****************************************************************************
 
 
 
   while (userbreak <1) {
-    grab_one ();
+    uint64_t t_stage;
+
+    // Stream off : camera stopped. Nobody watching : one frame every 1/CAPTURE_IDLE_FPS s
+    if (demand == DEMAND_STOP) wait_demand ();
+    skip_render = (demand == DEMAND_IDLE) && (histNowUs() < idle_next_us);
+    if ((demand == DEMAND_IDLE) && !skip_render) idle_next_us = histNowUs() + 1000000/CAPTURE_IDLE_FPS;
+
+    if ((grab_one () == -1) || skip_render) continue;
+
+    if (fifo_direct) {
+      // Rendered text straight from aalib to the FIFO, no aafile round trip
+      t_stage = histNowUs();
+      nbBytes = text_frame(fifo_buf, FIFO_BUF_SIZE);
+      fifo_header->length     = nbBytes;
+      fifo_header->columns    = aa_scrwidth(ascii_context);
+      fifo_header->rows       = nbBytes/(fifo_header->columns+1);
+      if(hyst_prev != NULL)
+        cells_changed += text_hysteresis(fifo_buf, hyst_prev, hyst_ref, aa_image(ascii_context),
+                                         fifo_header->columns, fifo_header->rows, hysteresis);
+      fifo_header->capture_us = capture_us;
+      fifo_header->write_us   = histNowUs();
+      nbBytes = write(fifo_fd, fifo_header, sizeof(struct FIFO_FRAME_HEADER) + nbBytes);
+      histRecord(&hist_fifo, histNowUs()-t_stage);
+      frames_written++;
+
+      if(t_stage-last_prom_dump >= PROM_PERIOD){
+        prom_dump();
+        last_prom_dump = t_stage;
+      }
+      continue;
+    }
 	/*aa_setpalette (gamma di colori, indice, colore rosso, verde, blu)*/
 
 	/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    t_stage = histNowUs();
     memcpy (aa_image (ascii_context), grey, vid_geo.size);
     aa_render (ascii_context, ascii_rndparms, 0, 0,
 	       vid_geo.w,vid_geo.h);
 
     aa_flush (ascii_context);
+    histRecord(&hist_file, histNowUs()-t_stage);
     //  unlink(aafile);
     rename(aatmpfile,aafile);
 
@@ -775,19 +878,30 @@ fifo_buf = malloc(FIFO_BUF_SIZE);
    if(aafile_fd == -1) printf("Unable to open the aafile (%s) \n", aafile);
 
    // aafile start
+   t_stage = histNowUs();
    fseek(aafile_fd, 0L, SEEK_SET);
-   while(!feof(aafile_fd)){
+   nbBytes = fread(fifo_buf, sizeof(char), FIFO_BUF_SIZE, aafile_fd);
+   //printf("%d bytes read from file\n", nbBytes);
+   copy_bytes += 2*nbBytes;   // aalib to aafile, aafile to fifo_buf
+
+   fifo_header->length     = nbBytes;
+   fifo_header->columns    = 0;      // aafile layout, the server gets the geometry from the text
+   fifo_header->rows       = 0;
+   fifo_header->capture_us = capture_us;
+   fifo_header->write_us   = histNowUs();
+   nbBytes = write(fifo_fd, fifo_header, sizeof(struct FIFO_FRAME_HEADER) + nbBytes);
+   //printf("%d bytes wrote in FIFO\n", nbBytes);
 
-      nbBytes = fread(fifo_buf, sizeof(char), FIFO_BUF_SIZE, aafile_fd);
-      //printf("%d bytes read from file\n", nbBytes);
-
-      nbBytes = write(fifo_fd, fifo_buf, nbBytes);
-      //printf("%d bytes wrote in FIFO\n", nbBytes);
+   fclose(aafile_fd);
+   histRecord(&hist_fifo, histNowUs()-t_stage);
+   frames_written++;
 
+   // Periodic Prometheus dump of the stage latencies
+   if(t_stage-last_prom_dump >= PROM_PERIOD){
+      prom_dump();
+      last_prom_dump = t_stage;
    }
 
-   fclose(aafile_fd);
-
 
    // *****************************************************************************
 
@@ -798,19 +912,16 @@ fifo_buf = malloc(FIFO_BUF_SIZE);
 
   /* CLEAN EXIT */
 
-  // turn off streaming
-  if(-1 == ioctl(fd, VIDIOC_STREAMOFF, &buftype)) {
-      perror("VIDIOC_STREAMOFF");
-  }
+  // turn off streaming and unmap the buffers
+  capture_close(&cap);
 
 /* Cleanup. */
 
-  for (i = 0; i < reqbuf.count; i++)
-      munmap (buffers[i].start, buffers[i].length);
-
   aa_close(ascii_context);
   free(grey);
-  if(fd>0) close(fd);
+  free(denoise_acc);
+  free(hyst_prev);
+  free(hyst_ref);
   fprintf (stderr, "cya!\n");
   exit (0);
 /*++userbreak;*/
@@ -824,3 +935,28 @@ quitproc (int Sig)
   fprintf (stderr, "interrupt caught, exiting.\n");
   userbreak = 1;
 }
+
+/* the server demand rides along the signal */
+void
+demandproc (int Sig, siginfo_t *info, void *context)
+{
+  demand = info->si_value.sival_int;
+}
+
+/* stream off : camera stopped, the device stays open, until the server
+   signals another demand */
+void
+wait_demand ()
+{
+  sigset_t block, old;
+
+  sigemptyset (&block);
+  sigaddset (&block, SIGUSR1);
+  sigprocmask (SIG_BLOCK, &block, &old);
+  if (demand == DEMAND_STOP) {
+    capture_pause (&cap);
+    while ((demand == DEMAND_STOP) && (userbreak < 1)) sigsuspend (&old);
+    if ((userbreak < 1) && (-1 == capture_resume (&cap))) vid_recover ();
+  }
+  sigprocmask (SIG_SETMASK, &old, NULL);
+}
@@ -0,0 +1,149 @@
+#pragma once
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/**
+* Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Project:    HEIA-FR / Embedded Systems 3 Laboratory
+*
+* Abstract:   Hasciicam client/server application
+*
+* Author:     C. Vallélian & G. Waeber
+* Class:      T-3a
+* Date:       19.01.2017
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+    Latency histogram (microseconds), shared by hasciicam (C) and server (C++)
+
+    Log-linear buckets like HDR histograms : values below HIST_LINEAR are
+    exact, above every power of two is split in HIST_SUB_BUCKETS buckets
+    (12.5% precision). Each histogram has a single writer thread, readers
+    (stats dump) only load the values, so no lock is needed.
+*/
+
+#define HIST_LINEAR       16                               // exact buckets 0..15 us
+#define HIST_SUB_BITS     3
+#define HIST_SUB_BUCKETS  (1 << HIST_SUB_BITS)             // buckets per power of two
+#define HIST_BUCKETS      (HIST_LINEAR + (32-4)*HIST_SUB_BUCKETS)
+
+struct HISTOGRAM {
+   uint32_t counts[HIST_BUCKETS];    // number of values per bucket
+   uint32_t count;                   // number of values
+   uint64_t sum;                     // sum of the values (us)
+   uint32_t max;                     // max value (us)
+};
+
+#define HIST_STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#define HIST_LOAD(field)         __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+
+/**
+ * Method to get the current monotonic time
+ *
+ * @return time in microseconds
+ */
+static inline uint64_t histNowUs(void){
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+/**
+ * Method to get the bucket index of a value
+ */
+static inline int histBucket(uint32_t value){
+   if(value < HIST_LINEAR) return value;
+   int e = 31 - __builtin_clz(value);                       // power of two, >= 4
+   return HIST_LINEAR + (e-4)*HIST_SUB_BUCKETS + ((value >> (e-HIST_SUB_BITS)) & (HIST_SUB_BUCKETS-1));
+}
+
+/**
+ * Method to get the highest value stored in a bucket
+ */
+static inline uint32_t histBucketValue(int bucket){
+   if(bucket < HIST_LINEAR) return bucket;
+   int e   = 4 + (bucket-HIST_LINEAR)/HIST_SUB_BUCKETS;
+   int sub = (bucket-HIST_LINEAR)%HIST_SUB_BUCKETS;
+   return (uint32_t)((((uint64_t)(HIST_SUB_BUCKETS+sub+1)) << (e-HIST_SUB_BITS)) - 1);
+}
+
+/**
+ * Method to record a value, only called by the writer thread
+ *
+ * @param h      histogram
+ * @param value  latency in microseconds
+ */
+static inline void histRecord(struct HISTOGRAM *h, uint64_t value){
+   uint32_t v = (value > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)value;
+   int      b = histBucket(v);
+   HIST_STORE(h->counts[b], h->counts[b]+1);
+   HIST_STORE(h->count, h->count+1);
+   HIST_STORE(h->sum, h->sum+v);
+   if(v > h->max) HIST_STORE(h->max, v);
+}
+
+/**
+ * Method to get a percentile of the recorded values
+ *
+ * @param h  histogram
+ * @param p  percentile (0.0 - 1.0)
+ *
+ * @return value (us) below which p of the values are, 0 if empty
+ */
+static inline uint32_t histPercentile(struct HISTOGRAM *h, double p){
+   uint32_t count = HIST_LOAD(h->count);
+   uint64_t rank  = (uint64_t)(p*count + 0.5);
+   uint64_t seen  = 0;
+   if(count == 0) return 0;
+   if(rank < 1) rank = 1;
+   for(int b = 0; b < HIST_BUCKETS; b++){
+      seen += HIST_LOAD(h->counts[b]);
+      if(seen >= rank){
+         uint32_t v   = histBucketValue(b);
+         uint32_t max = HIST_LOAD(h->max);
+         return (v < max) ? v : max;
+      }
+   }
+   return HIST_LOAD(h->max);
+}
+
+/**
+ * Method to write a histogram as a Prometheus summary
+ *
+ * @param f       output file
+ * @param name    metric name
+ * @param labels  extra labels ("" or "key=\"value\"")
+ * @param h       histogram
+ */
+static inline void histWritePrometheus(FILE *f, const char *name, const char *labels, struct HISTOGRAM *h){
+   static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+   const char *sep = (labels[0] != 0) ? "," : "";
+   for(unsigned int i = 0; i < sizeof(quantiles)/sizeof(quantiles[0]); i++){
+      fprintf(f, "%s{%s%squantile=\"%g\"} %u\n", name, labels, sep, quantiles[i], histPercentile(h, quantiles[i]));
+   }
+   fprintf(f, "%s_sum{%s} %llu\n", name, labels, (unsigned long long)HIST_LOAD(h->sum));
+   fprintf(f, "%s_count{%s} %u\n", name, labels, HIST_LOAD(h->count));
+   fprintf(f, "%s_max{%s} %u\n", name, labels, HIST_LOAD(h->max));
+}
+
+
+
+#endif
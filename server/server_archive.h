@@ -0,0 +1,169 @@
+#pragma once
+#ifndef SERVER_ARCHIVE_H
+#define SERVER_ARCHIVE_H
+
+
+/**
+* Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Project:    HEIA-FR / Embedded Systems 3 Laboratory
+*
+* Abstract:   Hasciicam client/server application
+*
+* Author:     C. Vallélian & G. Waeber
+* Class:      T-3a
+* Date:       19.01.2017
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../data.h"
+
+/*
+    Segment file of the recorded frames, ARCHIVE_DIR/segment-<first_us>.hca
+
+    +------------------------+  0
+    | ARCHIVE_HEADER         |
+    +------------------------+  index_offset
+    | ARCHIVE_INDEX          |  max_frames entries, sorted by capture time
+    | ...                    |
+    +------------------------+  data_offset
+    | frame data             |  raw or RLE, appended
+    +------------------------+  data_end
+
+    The writer appends the frame data, then its index entry, then updates
+    nb_frames : a reader mapping the file never sees a partial frame.
+    Segment names sort by the capture time of their first frame.
+*/
+
+struct ARCHIVE_HEADER {
+   uint32_t   magic;            // ARCHIVE_MAGIC
+   uint32_t   version;          // ARCHIVE_VERSION
+   uint32_t   nb_frames;        // frames committed
+   uint32_t   max_frames;       // entries of the index
+   uint64_t   index_offset;     // first index entry
+   uint64_t   data_offset;      // first frame data
+   uint64_t   data_end;         // end of the last frame data
+   uint64_t   first_us;         // capture time of the first frame (CLOCK_REALTIME, us)
+   uint64_t   last_us;          // capture time of the last frame (CLOCK_REALTIME, us)
+};
+
+struct ARCHIVE_INDEX {
+   uint64_t   capture_us;       // capture time (CLOCK_REALTIME, us)
+   uint64_t   offset;           // frame data offset in the file
+   uint32_t   frame_id;         // frame sequence number when recorded
+   uint16_t   length;           // stored length
+   uint16_t   codec;            // CODEC_RAW or CODEC_RLE
+   uint32_t   raw_length;       // frame length once decoded
+   uint32_t   reserved;         // alignment
+};
+
+// Segment being written
+struct ARCHIVE_WRITER {
+   int                   fd;    // segment file, -1 if none
+   struct ARCHIVE_HEADER header;
+   char                  buf[FIFO_BUF_SIZE];   // RLE encoded frame
+};
+
+// Segment mapped for replay
+struct ARCHIVE_SEGMENT {
+   void                        *map;       // whole file, NULL if not mapped
+   size_t                       size;      // mapped bytes
+   const struct ARCHIVE_HEADER *header;
+   const struct ARCHIVE_INDEX  *index;
+   int                          nb_frames; // frames complete in the mapping
+};
+
+
+
+/**
+ * Method to create a segment file in dir, named after its first frame
+ *
+ * @param w         writer
+ * @param dir       archive directory
+ * @param first_us  capture time of the first frame (CLOCK_REALTIME, us)
+ *
+ * @return 0 on success, -1 otherwise
+ */
+int archiveCreate(struct ARCHIVE_WRITER *w, const char *dir, uint64_t first_us);
+
+/**
+ * Method to append a frame to a segment, RLE encoded if smaller
+ *
+ * @param w           writer with a segment created
+ * @param frame       frame text
+ * @param length      frame length (<= FIFO_BUF_SIZE)
+ * @param frame_id    frame sequence number
+ * @param capture_us  capture time (CLOCK_REALTIME, us)
+ *
+ * @return stored bytes, 0 if the segment is full, -1 on error
+ */
+int archiveAppend(struct ARCHIVE_WRITER *w, const char *frame, int length, uint32_t frame_id, uint64_t capture_us);
+
+/**
+ * Method to close the segment being written
+ */
+void archiveClose(struct ARCHIVE_WRITER *w);
+
+/**
+ * Method to find the segment holding a capture time : the last segment
+ * starting at or before it, the first one if none
+ *
+ * @param dir    archive directory
+ * @param us     capture time (CLOCK_REALTIME, us), 0 for the oldest frame
+ * @param after  true for the first segment starting after us instead
+ * @param path   segment path found
+ * @param size   size of path
+ *
+ * @return 0 on success, -1 if there is no such segment
+ */
+int archiveFindSegment(const char *dir, uint64_t us, bool after, char *path, int size);
+
+/**
+ * Method to memory-map a segment for replay
+ *
+ * @return 0 on success, -1 if the file is not a segment
+ */
+int archiveMap(struct ARCHIVE_SEGMENT *seg, const char *path);
+
+/**
+ * Method to unmap a segment
+ */
+void archiveUnmap(struct ARCHIVE_SEGMENT *seg);
+
+/**
+ * Method to find the first frame captured at or after a time, binary
+ * search in the index
+ *
+ * @return frame index, seg->nb_frames if all the frames are older
+ */
+int archiveSeek(const struct ARCHIVE_SEGMENT *seg, uint64_t us);
+
+/**
+ * Method to decode a frame of a mapped segment
+ *
+ * @param seg   mapped segment
+ * @param i     frame index
+ * @param dst   frame text
+ * @param size  size of dst
+ *
+ * @return frame length, -1 if the frame is corrupted
+ */
+int archiveFrame(const struct ARCHIVE_SEGMENT *seg, int i, char *dst, int size);
+
+
+
+#endif
@@ -0,0 +1,138 @@
+#pragma once
+#ifndef SERVER_CAPTURE_H
+#define SERVER_CAPTURE_H
+
+
+/**
+* Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Project:    HEIA-FR / Embedded Systems 3 Laboratory
+*
+* Abstract:   Hasciicam client/server application
+*
+* Author:     C. Vallélian & G. Waeber
+* Class:      T-3a
+* Date:       19.01.2017
+*/
+
+#include "../data.h"
+#include "../frame_pool.h"
+
+/*
+    In-process capture engine : one thread per camera channel runs the
+    capture, grey conversion, denoise and text rendering of hasciicam
+    (hasciicam/capture.h and convert.h, native renderer) in the server.
+
+    The text is rendered directly in a slab of the channel frame pool, with
+    the colour runs of its cells right after it in colour mode, and
+    the slab is handed to server_thr_send by pointer through a pipe, with
+    the same header as a FIFO frame : no copy of the frame and no process
+    boundary. Device "test" is a synthetic camera, for boxes without one,
+    "test-still" the same scene standing still.
+
+    A monochrome camera is asked for its luminance alone (GREY) at the
+    smallest size still covering the text geometry, the grey image is then
+    sampled with smaller hops ; the colour text needs the chroma of YUYV at
+    the requested size. Frames are dequeued with poll, a camera silent for
+    CAPTURE_TIMEOUTS timeouts in a row is reopened.
+
+    A camera may have outputs, other text geometries published as their own
+    channels : the camera halves its grey image into a small pyramid once per
+    frame and a thread per output resamples the closest level above its
+    geometry and renders it, concurrently with the camera text.
+*/
+
+// Negotiation with the camera driver (server -y, -b, -i)
+struct CAPTURE_MODE {
+   bool         native;      // GREY at the smallest size covering the text when the driver has them, false for YUYV at the requested size
+   unsigned int buffers;     // driver buffers, CAPTURE_BUFFERS at most
+   unsigned int memory;      // V4L2_MEMORY_MMAP, _USERPTR or _DMABUF : camera buffers in a pool of the server
+};
+
+// Handoff of one frame, written at once in the pipe (less than PIPE_BUF)
+struct CAPTURE_HANDOFF {
+   struct FRAME             *frame;     // slab holding the text, one reference
+   struct FIFO_FRAME_HEADER  header;    // as hasciicam writes it in the FIFO
+};
+
+
+
+/**
+ * Method to open the camera of a channel and start its capture thread. The
+ * device is opened here, a failure is reported to the caller.
+ *
+ * @param channel   channel number
+ * @param device    V4L2 device, "test" or "test-still" for the synthetic camera, empty for the default
+ * @param width     capture width, 0 for the driver default
+ * @param height    capture height, 0 for the driver default
+ * @param denoise   temporal denoise strength (1-7), 0 off
+ * @param colour    COLOUR_256 or COLOUR_TRUE for colour text, COLOUR_NONE otherwise
+ * @param mode      pixel format, size, buffers and memory asked to the driver
+ *
+ * @return 0 on success, -1 otherwise (reason printed)
+ */
+int captureStart(unsigned int channel, const char *device, int width, int height, int denoise, int colour, const struct CAPTURE_MODE *mode);
+
+/**
+ * Method to declare an output of a camera channel : another text geometry
+ * rendered from the grey pyramid of the camera, published as its own
+ * channel. Declared before captureStart of the camera.
+ *
+ * @param channel  channel of the output
+ * @param parent   camera channel
+ * @param columns  text columns
+ * @param rows     text rows
+ *
+ * @return 0 on success, -1 if the geometry does not fit in a frame (reason printed)
+ */
+int captureOutput(unsigned int channel, unsigned int parent, int columns, int rows);
+
+/**
+ * Method to set the demand of a channel : its camera stops on DEMAND_STOP,
+ * renders CAPTURE_IDLE_FPS frames per second on DEMAND_IDLE and every frame
+ * on DEMAND_LIVE. A camera runs at the highest demand of its outputs.
+ *
+ * @param channel  channel number
+ * @param demand   DEMAND_*
+ */
+void captureDemand(unsigned int channel, int demand);
+
+/**
+ * Method to get the descriptor signaling the frames of a channel
+ *
+ * @param channel  channel number
+ *
+ * @return read end of the handoff pipe, -1 if the channel has no in-process capture
+ */
+int captureFd(unsigned int channel);
+
+/**
+ * Method to take the next frame of a channel, when captureFd is readable
+ *
+ * @param channel  channel number
+ * @param header   header of the frame
+ *
+ * @return frame with one reference for the caller, NULL on error
+ */
+struct FRAME *captureRead(unsigned int channel, struct FIFO_FRAME_HEADER *header);
+
+/**
+ * Method to stop the capture threads, each closes its camera when cancelled
+ */
+void captureStop(void);
+
+
+
+#endif
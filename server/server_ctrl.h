@@ -0,0 +1,89 @@
+#pragma once
+#ifndef SERVER_CTRL_H
+#define SERVER_CTRL_H
+
+/**
+* Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Project:    HEIA-FR / Embedded Systems 3 Laboratory
+*
+* Abstract:   Hasciicam client/server application
+*
+* Author:     C. Vallélian & G. Waeber
+* Class:      T-3a
+* Date:       19.01.2017
+*/
+
+#include <poll.h>
+
+/*
+    Control socket line protocol (one command per line, CTRL_SOCKET_PATH)
+    +-------------------+-------------------------------------------+
+    |      COMMAND      |                 MEANING                   |
+    +-------------------+-------------------------------------------+
+    | start             | enable the stream (like SW1)              |
+    | stop              | disable the stream (like SW2)             |
+    | list              | one line per subscriber :                 |
+    |                   | id ip:port channel <n>                    |
+    | kick <id>         | unsubscribe client <id>                   |
+    | fps <n>           | max frames per second, 0 for camera rate  |
+    | codec raw|rle     | codec used for the video data             |
+    | idle <ms>         | keepalive period of a static scene, 0 off |
+    | record on|off     | record the camera frames in ARCHIVE_DIR   |
+    | replay <us> [%]   | replay from a capture time (0 : oldest)   |
+    |                   | at a speed in percent (100 : real time)   |
+    | replay stop       | back to the camera                        |
+    | stats             | one line per counter : name value         |
+    +-------------------+-------------------------------------------+
+    Every answer ends with a line "OK" or "ERR <reason>".
+
+    Example : echo stats | nc -U /tmp/hasciicamCtrl
+*/
+
+
+
+/**
+ * Method to create the control socket listening on CTRL_SOCKET_PATH
+ *
+ * @return 0 on success, -1 otherwise
+ */
+int ctrlOpen(void);
+
+/**
+ * Method to fill the poll table with the control socket descriptors
+ *
+ * @param fds  poll table to fill
+ * @param max  number of free entries in fds
+ *
+ * @return number of entries filled
+ */
+int ctrlPollFds(struct pollfd *fds, int max);
+
+/**
+ * Method to handle the events returned by poll on the control descriptors
+ *
+ * @param fds  entries filled by ctrlPollFds
+ * @param nb   number of entries filled by ctrlPollFds
+ */
+void ctrlHandle(struct pollfd *fds, int nb);
+
+/**
+ * Method to close the control connections and remove the control socket
+ */
+void ctrlClose(void);
+
+
+
+#endif
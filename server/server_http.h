@@ -0,0 +1,103 @@
+#pragma once
+#ifndef SERVER_HTTP_H
+#define SERVER_HTTP_H
+
+
+/**
+* Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Project:    HEIA-FR / Embedded Systems 3 Laboratory
+*
+* Abstract:   Hasciicam client/server application
+*
+* Author:     C. Vallélian & G. Waeber
+* Class:      T-3a
+* Date:       19.01.2017
+*/
+
+#include <poll.h>
+#include <stdint.h>
+
+/*
+    HTTP/1.1 streaming endpoint on HTTP_PORT, served by server_thr_send
+    +-------------+--------------------------------------------------+
+    |    PATH     |                  ANSWER                          |
+    +-------------+--------------------------------------------------+
+    | /           | page displaying the stream (EventSource)         |
+    | /stream     | server-sent events, one event per frame          |
+    +-------------+--------------------------------------------------+
+    The sockets are non-blocking. Each frame is encoded once as an event
+    and written to every stream connection. A connection still sending the
+    previous frame skips the new one.
+
+    Example : curl -N http://odroid:8080/stream
+*/
+
+
+
+/**
+ * Method to create the HTTP socket listening on HTTP_PORT
+ *
+ * @return 0 on success, -1 otherwise
+ */
+int httpOpen(void);
+
+/**
+ * Method to fill the poll table with the HTTP socket descriptors
+ *
+ * @param fds  poll table to fill
+ * @param max  number of free entries in fds
+ *
+ * @return number of entries filled
+ */
+int httpPollFds(struct pollfd *fds, int max);
+
+/**
+ * Method to handle the events returned by poll on the HTTP descriptors
+ *
+ * @param fds  entries filled by httpPollFds
+ * @param nb   number of entries filled by httpPollFds
+ */
+void httpHandle(struct pollfd *fds, int nb);
+
+/**
+ * Method to send a frame to the stream connections, encoded once
+ *
+ * @param frame     frame text
+ * @param length    frame length
+ * @param frame_id  frame sequence number, event id
+ */
+void httpSendFrame(const char *frame, int length, uint32_t frame_id);
+
+/**
+ * Method to send a keepalive comment to the stream connections
+ */
+void httpKeepalive(void);
+
+/**
+ * Method to count the stream connections
+ *
+ * @return connections receiving the frames
+ */
+int httpViewers(void);
+
+/**
+ * Method to close the HTTP connections and the HTTP socket
+ */
+void httpClose(void);
+
+
+
+#endif
@@ -0,0 +1,109 @@
+#pragma once
+#ifndef SERVER_SCHED_H
+#define SERVER_SCHED_H
+
+
+/**
+* Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Project:    HEIA-FR / Embedded Systems 3 Laboratory
+*
+* Abstract:   Hasciicam client/server application
+*
+* Author:     C. Vallélian & G. Waeber
+* Class:      T-3a
+* Date:       19.01.2017
+*/
+
+#include <stddef.h>
+
+/*
+    CPU placement of the pipeline stages (SCHED_STAGE_*), server option
+    -a stage=cpus[:priority], for example on a big.LITTLE board :
+
+        server -a capture=4-7:60 -a send=4-7:50 -a receive=0-3 -a io=0-3
+
+    cpus is a list of CPUs and ranges, priority a SCHED_FIFO priority, 0
+    or none to keep the normal scheduler. Without the privileges (or with
+    CPUs missing on the box) the stage keeps the default placement and a
+    line is printed, the server runs the same.
+*/
+
+
+
+/**
+ * Method to parse the placement of a stage
+ *
+ * @param spec  stage=cpus[:priority]
+ *
+ * @return 0 on success, -1 if spec is not valid
+ */
+int schedParse(const char *spec);
+
+/**
+ * Method to apply the placement of a stage to the calling thread. The
+ * result is kept in the stats.
+ *
+ * @param stage  SCHED_STAGE_*
+ */
+void schedApply(int stage);
+
+/**
+ * Method to run a command with the placement of a stage, inherited by the
+ * processes it starts. The calling thread gets its placement back.
+ *
+ * @param stage  SCHED_STAGE_*
+ * @param cmd    shell command
+ *
+ * @return status of system()
+ */
+int schedSystem(int stage, const char *cmd);
+
+/**
+ * Method to record the CPU the calling thread runs on, counting the
+ * migrations of the stage. Cheap enough for every loop iteration.
+ *
+ * @param stage  SCHED_STAGE_*
+ */
+void schedSample(int stage);
+
+/**
+ * Method to get the name of a stage, as given to -a
+ *
+ * @param stage  SCHED_STAGE_*
+ *
+ * @return stage name
+ */
+const char *schedStageName(int stage);
+
+/**
+ * Method to lock a buffer in memory if the memory locking is enabled
+ * (server -m), it is never paged out
+ *
+ * @param addr  buffer
+ * @param len   buffer length
+ *
+ * @return 0 if locked, -1 otherwise
+ */
+int schedLock(const void *addr, size_t len);
+
+/**
+ * Method to enable the memory locking of the frame buffers
+ */
+void schedLockEnable(void);
+
+
+
+#endif
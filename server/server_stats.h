@@ -0,0 +1,228 @@
+#pragma once
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+/**
+* Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Project:    HEIA-FR / Embedded Systems 3 Laboratory
+*
+* Abstract:   Hasciicam client/server application
+*
+* Author:     C. Vallélian & G. Waeber
+* Class:      T-3a
+* Date:       19.01.2017
+*/
+
+#include <stdio.h>
+
+#include "../data.h"
+#include "../histogram.h"
+
+/*
+    Server counters and latency histograms. Every structure is written by one
+    thread only, the control socket and the Prometheus dump only read them.
+*/
+
+#define STAT_INC(field)        HIST_STORE(field, (field)+1)
+#define STAT_ADD(field, value) HIST_STORE(field, (field)+(value))
+
+
+// Per subscriber counters (index in the client socket table)
+struct STATS_CLIENT {
+   unsigned long datagrams;          // datagrams sent
+   unsigned long bytes;              // bytes sent
+   unsigned long drops;              // datagrams dropped (socket buffer full)
+   unsigned long errors;             // other sendto failures
+   unsigned long frames;             // frames sent
+   unsigned long tier;               // quality tier, 0 is the full stream
+   unsigned long tier_changes;       // quality tier changes
+   unsigned long loss;               // frames lost or incomplete in the last report period (per mille)
+   unsigned long jitter_us;          // jitter in the last receiver report (us)
+   unsigned long nacks;              // NACKs handled
+   unsigned long retransmits;        // fragments sent again
+   unsigned long nack_expired;       // fragments asked too late, frame abandoned
+   unsigned long nack_limited;       // fragments not sent again, NACK rate limit
+};
+
+struct STATS_CHANNEL {
+   unsigned long frames_read;        // frames read from the channel FIFO
+   unsigned long frames_sent;        // frames sent to the channel clients
+   unsigned long frames_idle;        // frames not sent, same content as the last frame sent
+   unsigned long first_frame_us;     // from the server start to the first frame read (gauge)
+   unsigned long demand;             // DEMAND_* signalled to the capture of the channel (gauge)
+   unsigned long wakeups;            // demand raises to DEMAND_LIVE
+};
+
+// Written by server_thr_send
+struct STATS_SEND {
+   unsigned long    frames_read;     // frames read from FIFO
+   unsigned long    frames_sent;     // frames sent to the clients
+   unsigned long    frames_skipped;  // frames dropped by the fps limit
+   unsigned long    datagrams;       // datagrams sent
+   unsigned long    bytes;           // bytes sent
+   unsigned long    send_drops;      // datagrams dropped (socket buffer full)
+   unsigned long    send_errors;     // other sendto failures
+   unsigned long    copy_bytes;      // bytes copied or encoded in intermediate buffers
+   unsigned long    pool_exhausted;  // frames dropped, no free slab in the frame pool
+   unsigned long    frames_idle;     // frames not sent, same content as the last frame sent
+   unsigned long    keepalives;      // keepalive datagrams sent instead of idle frames
+   unsigned long    rows_changed;    // rows different from the previous frame
+   unsigned long    idle_bytes_saved;// bytes the idle frames would have sent
+   unsigned long    idle_us_saved;   // send time the idle frames would have taken (us)
+   unsigned long    tier_changes;    // client quality tier changes
+   unsigned long    record_drops;    // frames not recorded, recorder late
+   unsigned long    live_dropped;    // frames read from FIFO and not sent during a replay
+   unsigned long    timeshift_bytes; // memory used by the recent frames ring (gauge)
+   unsigned long    timeshift_frames;// frames in the recent frames ring (gauge)
+   unsigned long    timeshift_evictions; // frames evicted from the ring
+   unsigned long    timeshift_hits;  // subscriptions behind live found in the ring
+   unsigned long    timeshift_misses;// subscriptions behind live older than the ring
+   unsigned long    timeshift_sent;  // ring frames sent to clients behind live
+   unsigned long    geometry_changes;// frame geometry changes of the channels
+   unsigned long    http_clients;    // HTTP stream connections (gauge)
+   unsigned long    http_frames;     // frames sent to HTTP stream connections
+   unsigned long    http_bytes;      // bytes sent to HTTP stream connections
+   unsigned long    http_drops;      // frames skipped, HTTP connection too slow
+   unsigned long    retransmits;     // fragments sent again on a NACK
+   unsigned long    nack_expired;    // fragments asked too late, frame abandoned
+   unsigned long    nack_limited;    // fragments not sent again, NACK rate limit
+   unsigned long    xdp_datagrams;   // datagrams queued to the AF_XDP TX ring (-X)
+   unsigned long    xdp_drops;       // datagrams dropped, AF_XDP TX ring or UMEM full
+   unsigned long    xdp_kicks;       // sendto calls waking the kernel up to transmit the TX ring
+   struct HISTOGRAM fifo_wait;       // time blocked reading a frame from FIFO
+   struct HISTOGRAM fifo_hop;        // from hasciicam FIFO write to FIFO read
+   struct HISTOGRAM hash;            // row and frame hashing of a frame
+   struct HISTOGRAM fragment;        // fragmentation and encoding of a frame
+   struct HISTOGRAM sendto;          // one sendto call
+   struct HISTOGRAM frame_send;      // whole frame, from FIFO read to last sendto
+   struct HISTOGRAM capture_to_send; // from V4L2 capture to last sendto
+   struct HISTOGRAM wake;            // from a demand raise to DEMAND_LIVE to the first frame read of the channel
+   struct STATS_CLIENT client[MAX_CLIENTS];
+   struct STATS_CHANNEL channel[MAX_CHANNELS];
+};
+
+// Written by server_thr_receive
+struct STATS_RECEIVE {
+   unsigned long    subscribes;      // accepted subscriptions
+   unsigned long    refused;         // refused subscriptions (table full)
+   unsigned long    unsubscribes;    // unsubscriptions
+   unsigned long    bad_requests;    // unknown commands received
+   unsigned long    ctrl_commands;   // commands received on the control socket
+   unsigned long    probes;          // clock probes answered
+   unsigned long    reports;         // receiver reports received
+   unsigned long    nacks;           // NACKs received from subscribers
+   unsigned long    batches;         // recvmmsg calls returning datagrams
+   unsigned long    rate_limited;    // datagrams dropped by the per-source rate limit
+   unsigned long    cookies_sent;    // subscribe cookies handed out
+   unsigned long    bad_cookies;     // subscriptions with a wrong or expired cookie
+   struct HISTOGRAM request;         // handling of one client request
+   struct CLIENT_REPORT report[MAX_CLIENTS];   // last receiver report per subscriber
+};
+
+// Written by server_thr_record
+struct STATS_RECORD {
+   unsigned long    frames;          // frames recorded
+   unsigned long    bytes;           // bytes written in the segments
+   unsigned long    segments;        // segment files created
+   unsigned long    errors;          // segment write failures
+   struct HISTOGRAM append;          // append of one frame
+};
+
+// Written by server_thr_replay
+struct STATS_REPLAY {
+   unsigned long    replays;         // replays started
+   unsigned long    frames;          // frames replayed
+   unsigned long    segments;        // segments mapped
+};
+
+// Written by server_thr_io
+struct STATS_IO {
+   unsigned long    button_presses;  // SW1/SW2 presses changing the stream state
+};
+
+// Written by the in-process capture thread of each channel (server_capture)
+struct STATS_CAPTURE {
+   unsigned long    frames;          // frames handed to server_thr_send
+   unsigned long    drops;           // frames dropped, no free slab or handoff pipe full
+   unsigned long    errors;          // capture failures, the device is reopened
+   unsigned long    timeouts;        // dequeues without a frame for CAPTURE_TIMEOUT_MS
+   unsigned long    lost;            // camera frames lost before the capture : dropped by the driver, corrupted
+   unsigned long    context_switches;// voluntary and involuntary, sampled every CAPTURE_USAGE_FRAMES frames
+   unsigned long    cpu_us;          // CPU of the thread, user and kernel, sampled every CAPTURE_USAGE_FRAMES frames (us)
+   unsigned long    idle_cpu_us;     // CPU of the thread out of DEMAND_LIVE, accounted at each demand change (us)
+   unsigned long    demand;          // DEMAND_* the camera runs at (gauge)
+   unsigned long    startup_us;      // from the device open to the first frame handed (gauge)
+   unsigned long    pixelformat;     // mode granted by the driver (gauges) : V4L2_PIX_FMT_GREY or _YUYV,
+   unsigned long    width, height;   // size,
+   unsigned long    buffers;         // buffers, 0 for the synthetic camera,
+   unsigned long    memory;          // V4L2_MEMORY_*
+   struct HISTOGRAM dequeue;         // VIDIOC_DQBUF
+   struct HISTOGRAM convert;         // grey conversion, denoise and pyramid (resampling for an output)
+   struct HISTOGRAM render;          // text rendering in the slab
+};
+
+// Per stage placement (SCHED_STAGE_*), written by the thread of the stage
+struct STATS_STAGE {
+   unsigned long    cpu;             // CPU of the last sample (gauge)
+   unsigned long    samples;         // CPU samples
+   unsigned long    migrations;      // CPU changes between two samples
+   unsigned long    pinned;          // 1 if the CPU set of -a is applied (gauge)
+   unsigned long    priority;        // SCHED_FIFO priority applied, 0 for the normal scheduler (gauge)
+};
+
+struct STATS_SCHED {
+   struct STATS_STAGE stage[SCHED_STAGES];
+   unsigned long    locked_bytes;    // frame buffers locked in memory (gauge, server_thr_send)
+};
+
+extern struct STATS_SEND    stats_send;
+extern struct STATS_RECEIVE stats_receive;
+extern struct STATS_IO      stats_io;
+extern struct STATS_RECORD  stats_record;
+extern struct STATS_REPLAY  stats_replay;
+extern struct STATS_SCHED   stats_sched;
+extern struct STATS_CAPTURE stats_capture[MAX_CHANNELS];
+extern uint64_t             stats_start_us;     // server start (CLOCK_MONOTONIC, us)
+
+
+
+/**
+ * Method to write a stats snapshot, one "name value" line per counter
+ *
+ * @param f  output file
+ */
+void statsWriteText(FILE *f);
+
+/**
+ * Method to write the stats in the Prometheus text format
+ *
+ * @param f  output file
+ */
+void statsWritePrometheus(FILE *f);
+
+/**
+ * Method to dump the stats in a Prometheus text file. The file is written
+ * next to path and then renamed, readers never see a partial file.
+ *
+ * @param path  Prometheus text file path
+ *
+ * @return 0 on success, -1 otherwise
+ */
+int statsDumpPrometheus(const char *path);
+
+
+
+#endif
@@ -0,0 +1,121 @@
+#pragma once
+#ifndef SERVER_TIMESHIFT_H
+#define SERVER_TIMESHIFT_H
+
+
+/**
+* Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Project:    HEIA-FR / Embedded Systems 3 Laboratory
+*
+* Abstract:   Hasciicam client/server application
+*
+* Author:     C. Vallélian & G. Waeber
+* Class:      T-3a
+* Date:       19.01.2017
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Ring of the recent frames, RLE encoded, to start a subscriber behind live
+
+    The frames are numbered by a sequence. The oldest frames are evicted when
+    a new frame does not fit in the byte budget or in the index, so the
+    memory used does not depend on the frame size. Only server_thr_send uses
+    the ring.
+*/
+
+struct TIMESHIFT_ENTRY {
+   uint64_t   capture_us;       // capture time (CLOCK_REALTIME, us)
+   uint32_t   frame_id;         // frame sequence number when sent live
+   uint32_t   offset;           // RLE frame in the byte ring
+   uint16_t   length;           // RLE frame length
+   uint16_t   raw_length;       // frame length once decoded
+};
+
+struct TIMESHIFT {
+   char                   *buf;          // byte ring
+   size_t                  size;         // byte ring size (budget)
+   struct TIMESHIFT_ENTRY *entries;      // index, entry of seq at seq % max_entries
+   int                     max_entries;
+   uint64_t                tail;         // sequence of the oldest frame
+   uint64_t                head;         // sequence of the next frame
+   size_t                  write_pos;    // next write in buf
+   size_t                  used;         // bytes of the frames in the ring
+   unsigned long           evictions;    // frames evicted
+};
+
+
+
+/**
+ * Method to allocate a ring
+ *
+ * @param ts           ring
+ * @param bytes        byte budget of the frames
+ * @param max_entries  max number of frames
+ *
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int timeshiftInit(struct TIMESHIFT *ts, size_t bytes, int max_entries);
+
+/**
+ * Method to free a ring
+ */
+void timeshiftDestroy(struct TIMESHIFT *ts);
+
+/**
+ * Method to add a frame to the ring, the oldest frames are evicted if needed
+ *
+ * @param ts          ring
+ * @param frame       frame text
+ * @param length      frame length
+ * @param frame_id    frame sequence number
+ * @param capture_us  capture time (CLOCK_REALTIME, us)
+ *
+ * @return 0 on success, -1 if the frame does not fit in the ring
+ */
+int timeshiftAppend(struct TIMESHIFT *ts, const char *frame, int length, uint32_t frame_id, uint64_t capture_us);
+
+/**
+ * Method to find the oldest frame captured at or after a time, binary search
+ *
+ * @return sequence of the frame, ts->head if all the frames are older
+ */
+uint64_t timeshiftSeek(const struct TIMESHIFT *ts, uint64_t us);
+
+/**
+ * Method to decode a frame of the ring
+ *
+ * @param ts    ring
+ * @param seq   sequence of the frame
+ * @param dst   frame text
+ * @param size  size of dst
+ *
+ * @return entry of the frame, NULL if evicted or not in the ring yet
+ */
+const struct TIMESHIFT_ENTRY *timeshiftFrame(const struct TIMESHIFT *ts, uint64_t seq, char *dst, int size);
+
+/**
+ * Method to get the memory used by the ring
+ *
+ * @return bytes of the frames and of the index
+ */
+size_t timeshiftMemory(const struct TIMESHIFT *ts);
+
+
+
+#endif
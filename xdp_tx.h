@@ -0,0 +1,151 @@
+#pragma once
+#ifndef XDP_TX_H
+#define XDP_TX_H
+
+/**
+* Copyright 2016 University of Applied Sciences Western Switzerland / Fribourg
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Project:    HEIA-FR / Embedded Systems 3 Laboratory
+*
+* Abstract:   Hasciicam client/server application
+*
+* Author:     C. Vallélian & G. Waeber
+* Class:      T-3a
+* Date:       23.12.2016
+*/
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/*
+    AF_XDP transmitter
+
+    The datagrams are built as Ethernet frames in a UMEM shared with the
+    kernel and handed to one queue of an interface through the TX ring of an
+    XSK socket : no socket lookup, routing nor UDP/IP stack per datagram. The
+    payload of a fragment is copied once in the UMEM and chained after the
+    Ethernet/IP/UDP header of every peer (multi-buffer descriptors), or
+    copied behind each header if the kernel has no multi-buffer AF_XDP.
+
+    Zero-copy is asked to the driver first, then copy mode, the generic (SKB)
+    path every interface has, a veth pair included. No XDP program is
+    needed to transmit. The UDP checksum is left out (0, allowed in IPv4).
+*/
+
+#define XDP_FRAMES      1024     // UMEM chunks
+#define XDP_FRAME_SIZE  4096     // bytes per chunk
+#define XDP_RING_SIZE   512      // TX and completion ring entries
+#define XDP_HEADERS     42       // Ethernet, IPv4 and UDP headers in front of each datagram
+#define XDP_MAX_PAYLOAD (XDP_FRAME_SIZE-XDP_HEADERS)   // datagram bytes (UDP payload) a chunk holds
+
+// Ring of the XSK socket, mapped from the kernel
+struct XDP_RING {
+   uint32_t *producer;
+   uint32_t *consumer;
+   uint32_t *flags;                 // XDP_RING_NEED_WAKEUP
+   void     *ring;                  // descriptors (TX) or addresses (completion)
+   uint32_t  size;                  // entries, power of 2
+   uint32_t  cached;                // our producer (TX) or consumer (completion) index
+   void     *map;                   // mmap of the ring
+   size_t    map_size;
+};
+
+// Destination reached through the interface
+struct XDP_PEER {
+   struct sockaddr_in to;           // address and port of the peer
+   uint32_t           from;         // source address of the datagrams (network order)
+   unsigned char      mac[6];       // next hop : the peer or its gateway
+};
+
+struct XDP_TX {
+   int             fd;              // XSK socket, -1 if closed
+   char            ifname[16];
+   int             ifindex;
+   unsigned int    queue;           // queue of the interface bound
+   bool            zerocopy;        // the driver transmits from the UMEM, copy mode otherwise
+   bool            sg;              // multi-buffer : one payload chunk shared by the peers
+   unsigned char   mac[6];          // interface MAC
+   unsigned char  *umem;            // XDP_FRAMES chunks of XDP_FRAME_SIZE
+   struct XDP_RING tx;
+   struct XDP_RING cq;              // completion ring : chunks sent
+   uint32_t        free[XDP_FRAMES];// free chunks stack
+   int             nb_free;
+   uint16_t        refs[XDP_FRAMES];// TX descriptors in flight per chunk
+   uint16_t        ip_id;           // IPv4 identification of the next datagram
+   unsigned long   datagrams;       // datagrams queued
+   unsigned long   drops;           // datagrams dropped, ring or UMEM full
+   unsigned long   kicks;           // sendto calls waking the kernel up
+};
+
+
+
+/**
+ * Method to open an AF_XDP socket on a queue of an interface, its UMEM and
+ * its rings : zero-copy if the driver has it, else copy mode
+ *
+ * @param x        transmitter
+ * @param ifname   interface
+ * @param queue    queue of the interface
+ *
+ * @return 0 on success, -1 if AF_XDP is unavailable (reason printed)
+ */
+int xdpOpen(struct XDP_TX *x, const char *ifname, unsigned int queue);
+
+/**
+ * Method to close the socket and free the UMEM, the datagrams not sent yet are lost
+ */
+void xdpClose(struct XDP_TX *x);
+
+/**
+ * Method to resolve a destination through the interface : source address,
+ * next hop and its MAC from the routing and neighbour tables
+ *
+ * @param x     transmitter
+ * @param to    destination
+ * @param peer  destination resolved
+ *
+ * @return 0 on success, -1 if the destination is not reached through the interface or has no neighbour entry yet
+ */
+int xdpPeer(struct XDP_TX *x, const struct sockaddr_in *to, struct XDP_PEER *peer);
+
+/**
+ * Method to queue one datagram to each peer, same content for all : iov[0]
+ * (the header) is copied behind the UDP/IP header of each peer, iov[1] (the
+ * payload, may be empty) is copied once and shared
+ *
+ * @param x      transmitter
+ * @param peers  destinations
+ * @param nb     number of destinations
+ * @param port   UDP source port (network order)
+ * @param iov    header and payload of the datagram
+ * @param sent   true for each peer the datagram is queued to
+ *
+ * @return datagrams queued, the others are dropped (TX ring or UMEM full)
+ */
+int xdpSend(struct XDP_TX *x, const struct XDP_PEER *peers, int nb, uint16_t port, const struct iovec iov[2], bool *sent);
+
+/**
+ * Method to wake the kernel up to transmit the datagrams queued, and take
+ * the chunks sent back
+ *
+ * @return 0 on success, -1 on a socket error
+ */
+int xdpFlush(struct XDP_TX *x);
+
+
+
+#endif